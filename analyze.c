@@ -8,30 +8,12 @@
 
 #include "globals.h"
 #include "symtab.h"
+#include "util.h"
 #include "analyze.h"
 
 static char* scope_name = NULL;
 static TreeNode* param_tree = NULL;
 
-/* Procedure traverse is a generic recursive 
- * syntax tree traversal routine:
- * it applies preProc in preorder and postProc 
- * in postorder to tree pointed to by t
- */
-static void traverse( TreeNode * t,
-               void (* preProc) (TreeNode *),
-               void (* postProc) (TreeNode *) )
-{ if (t != NULL)
-  { preProc(t);
-    { int i;
-      for (i=0; i < MAXCHILDREN; i++)
-        traverse(t->child[i],preProc,postProc);
-    }
-    postProc(t);
-    traverse(t->sibling,preProc,postProc);
-  }
-}
-
 /* nullProc is a do-nothing procedure to 
  * generate preorder-only or postorder-only
  * traversals from traverse
@@ -42,32 +24,79 @@ static void nullProc(TreeNode * t)
   else return;
 }
 */
+/* Function bind returns the symbol identifier
+ * node t refers to from the current scope and
+ * caches it with its scope in t, or NULL if
+ * t is undeclared
+ */
+static BucketList bind(TreeNode * t)
+{ if (t->sym == NULL)
+  { t->scope = find_scope_by_var(sc_top(), t->attr.name);
+    if (t->scope != NULL)
+      t->sym = st_lookup_excluding_parent(t->scope, t->attr.name);
+  }
+  return t->sym;
+}
+
 typedef enum {Undefined, VoidVar, ReturnType, Assignment, FuncParam} ErrorType;
 
 static void printError(ErrorType err, TreeNode* t) {
   switch (err) {
     case Undefined:
       if (t->kind.exp != CallK)
-        printf("error: Undeclared variable %s at line %d\n", t->attr.name, t->lineno);
+        fprintf(listing, "error: Undeclared variable %s at line %d\n", t->attr.name, t->lineno);
       else
-        printf("error: Undeclared function %s at line %d\n", t->attr.name, t->lineno);
+        fprintf(listing, "error: Undeclared function %s at line %d\n", t->attr.name, t->lineno);
       break;
     case VoidVar:
-      printf("error: Variable type cannot be Void at line %d\n", t->lineno);
+      fprintf(listing, "error: Variable type cannot be Void at line %d\n", t->lineno);
       break;
     case ReturnType:
-      printf("Type error at line %d: return type inconsistance\n", t->lineno);
+      fprintf(listing, "Type error at line %d: return type inconsistance\n", t->lineno);
       break;
     case Assignment:
-      printf("error: Type inconsistance at line %d\n", t->lineno);
+      fprintf(listing, "error: Type inconsistance at line %d\n", t->lineno);
       break;
     case FuncParam:
-      printf("Type error at line %d: invalid function call\n", t->lineno);
+      fprintf(listing, "Type error at line %d: invalid function call\n", t->lineno);
       break;
   }
   Error = TRUE;
 }
 
+/* Procedure insertParams inserts the parameters
+ * saved by insertNode into the current scope
+ */
+static void insertParams(void)
+{ int param_num = 0;
+  while (param_tree) {
+    if (param_tree->kind.param == ArrParamK) {
+      st_insert(sc_top(), param_tree, IntegerArray, ParamVar, param_num++);
+    }
+    else {
+      st_insert(sc_top(), param_tree, Integer, ParamVar, param_num++);
+    }
+    param_tree = param_tree->sibling;
+  }
+}
+
+/* Procedure endFunction finishes function
+ * declaration t: a prototype gets a scope of
+ * its own for its parameters, so calls can be
+ * checked and generated before (or without)
+ * the body
+ */
+static void endFunction( TreeNode * t)
+{ BucketList f = st_lookup_function(t->attr.name);
+  if (t->child[2] != NULL) {
+    if (f != NULL) f->defined = TRUE;
+    return;
+  }
+  sc_push(t->attr.name, -1);
+  insertParams();
+  sc_pop();
+}
+
 static void afterInsertNode( TreeNode * t) {
   switch (t->nodekind) 
   { case StmtK:
@@ -81,6 +110,7 @@ static void afterInsertNode( TreeNode * t) {
     case DeclK:
       switch (t->kind.exp)
       { case FuncK:
+          if (t->nodekind == DeclK) endFunction(t);
           init_memloc();
           break;
         default:
@@ -100,10 +130,8 @@ static void afterInsertNode( TreeNode * t) {
 
 
 static void insertNode( TreeNode * t)
-{ Scope tmp = NULL;
-  BucketList tmp_l = NULL;
+{ BucketList tmp_l = NULL;
   BucketList tmp_l2 = NULL;
-  int param_num = 0;
   
   switch (t->nodekind)
   { case StmtK:
@@ -111,15 +139,7 @@ static void insertNode( TreeNode * t)
       { case CompK:
           sc_push(scope_name, -1);
           t->scope = sc_top();
-          while (param_tree) {
-            if (param_tree->kind.param == ArrParamK) {
-              st_insert(sc_top(), param_tree, IntegerArray, ParamVar, param_num++);
-            }
-            else {
-              st_insert(sc_top(), param_tree, Integer, ParamVar, param_num++);
-            }
-            param_tree = param_tree->sibling;
-          }
+          insertParams();
           break;
         default:
           break;
@@ -130,7 +150,7 @@ static void insertNode( TreeNode * t)
       { case AssignK:
           // cass 1: IdK
           if (t->child[0]->kind.exp == IdK) {
-            tmp_l = st_lookup(sc_top(), t->child[0]->attr.name);
+            tmp_l = bind(t->child[0]);
             if (tmp_l == NULL) {
                 break;
             }
@@ -144,7 +164,7 @@ static void insertNode( TreeNode * t)
               // c1 : r-val is call
               case CallK:
               case IdK:
-                tmp_l2 = st_lookup(sc_top(), t->child[1]->attr.name);
+                tmp_l2 = bind(t->child[1]);
                 if (tmp_l2 == NULL) {
                   break;
                 }
@@ -174,7 +194,7 @@ static void insertNode( TreeNode * t)
               // c1 : r-val is call
               case IdK:
               case CallK:
-                tmp_l2 = st_lookup(sc_top(), t->child[1]->attr.name);
+                tmp_l2 = bind(t->child[1]);
                 if (tmp_l2 == NULL) {
                   break;
                 }
@@ -187,34 +207,26 @@ static void insertNode( TreeNode * t)
           }
           break;
         case IdK:
-          tmp = find_scope_name_by_var(sc_top(), t->attr.name);
-          // printf("%s : scope name and address : %x\n", tmp_name, tmp_name);
-          if (tmp == NULL) {
+          if (bind(t) == NULL) {
             printError(Undefined, t);
             break;
           }
-          // why it works?? ask to someone why it works is needed!!
-          st_insert(tmp, t, 0, Default, -1);
+          st_insert(t->scope, t, 0, Default, -1);
           break;
         case ArrIdK:
-          tmp = find_scope_name_by_var(sc_top(), t->attr.name);
-          // printf("%s : scope name and address : %x\n", tmp_name, tmp_name);
-          if (tmp == NULL) {
+          if (bind(t) == NULL) {
             printError(Undefined, t);
             break;
           }
-          // why it works?? ask to someone why it works is needed!!
-          st_insert(tmp, t, 0, NormalVar, -1);
+          st_insert(t->scope, t, 0, NormalVar, -1);
           break;
         case CallK:
-          tmp = find_scope_name_by_var(sc_top(), t->attr.name);
-          // printf("%s : scope name and address : %x\n", tmp_name, tmp_name);
-          if (tmp == NULL) {
+          if (bind(t) == NULL) {
             printError(Undefined, t);
             break;
           }
-          // why it works?? ask to someone why it works is needed!!
-          st_insert(tmp, t, 0, Func, -1);
+          st_insert(t->scope, t, 0, Func, -1);
+          t->sym->called = TRUE;
           break;   
         default:
           break;
@@ -263,7 +275,7 @@ static void insertNode( TreeNode * t)
  */
 void buildSymtab(TreeNode * syntaxTree)
 { sc_init();
-  traverse(syntaxTree,insertNode,afterInsertNode);
+  walkTree(syntaxTree,insertNode,afterInsertNode);
   if (TraceAnalyze)
   { fprintf(listing,"\nSymbol table:\n\n");
     printSymTab(listing);
@@ -295,7 +307,7 @@ static void beforeCheckNode(TreeNode *t) {
  */
 static void checkNode(TreeNode * t) {
   BucketList l;
-  BucketList* param_list = (BucketList*)malloc(sizeof(BucketList)*32);
+  BucketList* param_list;
   BucketList tmp_l;
   BucketList tmp_l2;
   TreeNode *param_t;
@@ -305,10 +317,7 @@ static void checkNode(TreeNode * t) {
   switch (t->nodekind)
   { case StmtK:
       switch (t->kind.stmt)
-      { case CompK:
-          sc_pop(); 
-          break;
-        case IterK:
+      { case IterK:
           switch (t->child[0]->kind.exp) {
               // c0 : r-val is var
               case ArrIdK:
@@ -316,7 +325,7 @@ static void checkNode(TreeNode * t) {
               // c1 : r-val is call
               case IdK:
               case CallK:
-                tmp_l2 = st_lookup(sc_top(), t->child[0]->attr.name);
+                tmp_l2 = bind(t->child[0]);
                 if (tmp_l2 == NULL) {
                   break;
                 }
@@ -353,7 +362,7 @@ static void checkNode(TreeNode * t) {
               // c1 : r-val is call
               case IdK:
               case CallK:
-                tmp_l2 = st_lookup(sc_top(), t->child[0]->attr.name);
+                tmp_l2 = bind(t->child[0]);
                 if (tmp_l2 == NULL) {
                   break;
                 }
@@ -377,29 +386,17 @@ static void checkNode(TreeNode * t) {
     case ExpK:
       switch (t->kind.exp)
       { case CallK:
-          // get param list. 
-          memset(param_list, 0x00, sizeof(BucketList)*32);
-          get_param_list(t->attr.name, param_list);
-          if (param_list == NULL) {
-              break;
-          }
+          // get param list from the function symbol
+          l = st_lookup_function(t->attr.name);
+          param_list = (l != NULL) ? l->params : NULL;
+          valid = (l != NULL) ? l->numParams : 0;
 
           // check param, positional param ...
           param_t = t->child[0];
           j=0;
-          valid = 0;
-          for (i=0;i<MAX_SCOPE_NUM;i++) {
-            if (param_list[i] == NULL) {
-              break;
-            }
-            valid++;
-          }
 
           while (param_t) {
-            for (i=0;i<MAX_SCOPE_NUM;i++) {
-              if (param_list[i] == NULL) {
-                break;
-              }
+            for (i=0;i<valid;i++) {
               if (param_list[i]->param_opt == j) {
                 tmp_l = st_lookup(sc_top(), param_list[i]->name);
                 if (tmp_l != NULL) {
@@ -413,7 +410,7 @@ static void checkNode(TreeNode * t) {
                     // c1 : r-val is call
                     case IdK:
                     case CallK:
-                      tmp_l2 = st_lookup(sc_top(), param_t->attr.name);
+                      tmp_l2 = bind(param_t);
                       if (tmp_l2 == NULL) {
                       break;
                       }
@@ -440,7 +437,7 @@ static void checkNode(TreeNode * t) {
         case OpK:
           // cass 1: IdK
           if (t->child[0]->kind.exp == IdK) {
-            tmp_l = st_lookup(sc_top(), t->child[0]->attr.name);
+            tmp_l = bind(t->child[0]);
             if (tmp_l == NULL) {
                 break;
             }
@@ -452,7 +449,7 @@ static void checkNode(TreeNode * t) {
           // case 2: ArrIdK -> OK
           // case 3: CallK
           else if (t->child[0]->kind.exp == CallK) {
-            tmp_l = st_lookup(sc_top(), t->child[0]->attr.name);
+            tmp_l = bind(t->child[0]);
             if (tmp_l == NULL) {
               break;
             }
@@ -463,7 +460,7 @@ static void checkNode(TreeNode * t) {
           }
           // cass 1: IdK
           if (t->child[1]->kind.exp == IdK) {
-            tmp_l = st_lookup(sc_top(), t->child[1]->attr.name);
+            tmp_l = bind(t->child[1]);
             if (tmp_l == NULL) {
                 break;
             }
@@ -477,7 +474,7 @@ static void checkNode(TreeNode * t) {
           // case 2: ArrIdK -> OK
           // case 3: CallK
           else if (t->child[1]->kind.exp == CallK) {
-            tmp_l = st_lookup(sc_top(), t->child[1]->attr.name);
+            tmp_l = bind(t->child[1]);
             if (tmp_l == NULL) {
               break;
             }
@@ -496,9 +493,41 @@ static void checkNode(TreeNode * t) {
   }
 }
 
+/* Procedure afterCheckNode checks t and leaves
+ * the scope of a compound statement
+ */
+static void afterCheckNode(TreeNode * t) {
+  checkNode(t);
+  if ((t->nodekind == StmtK) && (t->kind.stmt == CompK))
+    sc_pop();
+}
+
 /* Procedure typeCheck performs type checking 
  * by a postorder syntax tree traversal
  */
 void typeCheck(TreeNode * syntaxTree)
-{ traverse(syntaxTree,beforeCheckNode,checkNode);
+{ walkTree(syntaxTree,beforeCheckNode,afterCheckNode);
+}
+
+/* Procedure afterAnalyzeNode checks t while its
+ * scope is still the current one, then leaves
+ * it as afterInsertNode does
+ */
+static void afterAnalyzeNode(TreeNode * t) {
+  checkNode(t);
+  afterInsertNode(t);
+}
+
+/* Procedure analyze builds the symbol table and
+ * checks types in one walk of the syntax tree:
+ * each node is checked in postorder, when every
+ * declaration it can see has been inserted
+ */
+void analyze(TreeNode * syntaxTree)
+{ sc_init();
+  walkTree(syntaxTree,insertNode,afterAnalyzeNode);
+  if (TraceAnalyze)
+  { fprintf(listing,"\nSymbol table:\n\n");
+    printSymTab(listing);
+  }
 }
@@ -18,4 +18,9 @@ void buildSymtab(TreeNode *);
  */
 void typeCheck(TreeNode *);
 
+/* Procedure analyze does the work of buildSymtab
+ * and typeCheck in a single tree traversal
+ */
+void analyze(TreeNode *);
+
 #endif
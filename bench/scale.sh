@@ -0,0 +1,62 @@
+#!/bin/sh
+# scale.sh: compile generated C-Minus programs of growing
+# size and print the time for each; with a linear-time
+# front end the time roughly doubles with the size
+#
+# usage: sh bench/scale.sh [cminus] [start size] [steps]
+#
+# program n has n global declarations and a main with n
+# expression statements, so the declaration and statement
+# lists of the grammar grow with n
+
+CMINUS=${1:-./cminus}
+N=${2:-10000}
+STEPS=${3:-4}
+DIR=${TMPDIR:-/tmp}/cminus_scale_$$
+mkdir -p $DIR || exit 1
+trap 'rm -rf $DIR' 0
+
+# gen n file: writes program n to file (no '.' in
+# the directory, cminus cuts the name at the first '.')
+gen() {
+  awk -v n=$1 '
+    function name(i,  s) {
+      s = ""
+      do { s = sprintf("%c", 97 + i % 26) s; i = int(i / 26) } while (i > 0)
+      return "x" s
+    }
+    BEGIN {
+      for (i = 0; i < n; i++) printf "int %s;\n", name(i)
+      print "int sum(int a, int b) { return a + b; }"
+      print "void main(void)\n{"
+      for (i = 0; i < n; i++) printf "  %d;\n", i
+      printf "  output(sum(1, 2));\n}\n"
+    }' > $2
+}
+
+# now: wall clock in milliseconds
+now() {
+  echo $(( $(date +%s%N) / 1000000 ))
+}
+
+printf "%10s %10s %10s\n" size ms ratio
+last=0
+i=0
+while [ $i -lt $STEPS ]
+do
+  gen $N $DIR/p.cm
+  t0=$(now)
+  $CMINUS $DIR/p.cm > $DIR/p.lst || exit 1
+  t=$(( $(now) - t0 ))
+  if grep -q -i error $DIR/p.lst
+  then grep -i error $DIR/p.lst | head -5; exit 1
+  fi
+  if [ $last -gt 0 ]
+  then ratio=$(awk -v a=$t -v b=$last 'BEGIN { printf "%.2f", a / b }')
+  else ratio=-
+  fi
+  printf "%10d %10d %10s\n" $N $t $ratio
+  last=$t
+  N=$(( N * 2 ))
+  i=$(( i + 1 ))
+done
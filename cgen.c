@@ -7,9 +7,19 @@
 /* Kenneth C. Louden                                */
 /****************************************************/
 
+/* Statements are generated by walkChildren, whose
+ * stack is on the heap, so deeply nested statements
+ * do not grow the C stack. Each expression is still
+ * generated recursively by genExp and genReg, so the
+ * C stack grows with the nesting of one expression
+ */
+
 #include "globals.h"
 #include "symtab.h"
+#include "util.h"
 #include "code.h"
+#include "peep.h"
+#include "link.h"
 #include "cgen.h"
 
 /* tmpOffset is the memory offset for temps
@@ -21,110 +31,427 @@ static int mainStarter = 0;
 
 static int functionSkip = 0;
 
-/* prototype for internal recursive code generator */
+/* the declaration of main, whose code goes
+ * last (see hasCode), and whether it is being
+ * generated
+ */
+static TreeNode * mainDecl = NULL;
+static int genMain = FALSE;
+
+/* the state of a node between the hooks of
+ * cGen's walk: the line to restore after it,
+ * the code locations an if or while statement
+ * backpatches and its conditional jump; genTop
+ * indexes the innermost node being generated
+ */
+typedef struct
+   { int line;
+     int loc1, loc2;
+     char * jump;
+   } GenState;
+
+static GenState * genStack = NULL;
+static int genTop = -1, genSize = 0;
+
+/* prototype for internal code generator */
 static void cGen (TreeNode * tree);
+static void genExp (TreeNode * tree);
+static char * genCond (TreeNode * tree);
+static void genFuncStart (TreeNode * tree);
+static void genFuncEnd (TreeNode * tree);
 
-/* Procedure genStmt generates code at a statement node */
-static void genStmt( TreeNode * tree)
-{ TreeNode * p1, * p2, * p3;
-  int savedLoc1,savedLoc2,currentLoc;
-  int loc;
+/* Procedure genStmtStart generates the code of a
+ * statement node before its children
+ */
+static void genStmtStart( TreeNode * tree, GenState * g)
+{ TreeNode * p1 = tree->child[0];
+  int line;
   switch (tree->kind.stmt) {
       case CompK:
          /* set scope */
          set_cur_scope(tree->scope);
+         break;
+      case IfK :
+         if (TraceCode) emitComment("-> if") ;
+         /* generate code for test expression, at the
+          * test's line rather than the end of the if */
+         line = emitLine(p1->lineno);
+         g->jump = genCond(p1);
+         emitLine(line);
+         g->loc1 = emitSkip(1) ;
+         emitComment("if: jump to else belongs here");
+         break;
+      case IterK:
+         if (TraceCode) emitComment("-> iter") ;
+         g->loc1 = emitSkip(0);
+         emitComment("repeat: jump after body comes back here");
+         /* generate code for test */
+         line = emitLine(p1->lineno);
+         g->jump = genCond(p1);
+         emitLine(line);
+         g->loc2 = emitSkip(1);
+         break;
+      case RetK:
+         if (TraceCode) emitComment("-> return");
+         break;
+      default:
+         break;
+    }
+} /* genStmtStart */
+
+/* Function genStmtChild generates the code of a
+ * statement node before child i and tells
+ * whether child i gets code:
+ * CompK: 0 local declarations, 1 statements
+ * IfK: 0 test, 1 then part, 2 else part
+ * IterK: 0 test, 1 body
+ * RetK: 0 value (or NULL)
+ */
+static int genStmtChild( TreeNode * tree, int i, GenState * g)
+{ int currentLoc;
+  switch (tree->kind.stmt) {
+      case CompK:
+      case IterK:
+         return i == 1;
+      case IfK :
+         if (i == 2) {
+           g->loc2 = emitSkip(1) ;
+           emitComment("if: jump to end belongs here");
+           currentLoc = emitSkip(0) ;
+           emitBackup(g->loc1) ;
+           emitRM_Abs(g->jump,ac,currentLoc,"if: jmp to else");
+           emitRestore() ;
+         }
+         return i >= 1;
+      case RetK:
+         return i == 0;
+      default:
+         return FALSE;
+    }
+} /* genStmtChild */
 
-         /* t->child[0]: local var declaration
-          * t->child[1]; statements
-          */
-         cGen(tree->child[1]);
-
+/* Procedure genStmtEnd generates the code of a
+ * statement node after its children
+ */
+static void genStmtEnd( TreeNode * tree, GenState * g)
+{ int currentLoc;
+  switch (tree->kind.stmt) {
+      case CompK:
          /* escape from scope */
          sc_pop();
          break;
       case IfK :
-         if (TraceCode) emitComment("-> if") ;
-
-         /* p1: cond
-          * p2: if statement
-          * p3: else statement
-          */
-         p1 = tree->child[0] ;
-         p2 = tree->child[1] ;
-         p3 = tree->child[2] ;
-         /* generate code for test expression */
-         cGen(p1);
-         savedLoc1 = emitSkip(1) ;
-         emitComment("if: jump to else belongs here");
-         /* recurse on then part */
-         cGen(p2);
-         savedLoc2 = emitSkip(1) ;
-         emitComment("if: jump to end belongs here");
-         currentLoc = emitSkip(0) ;
-         emitBackup(savedLoc1) ;
-         emitRM_Abs("JEQ",ac,currentLoc,"if: jmp to else");
-         emitRestore() ;
-         /* recurse on else part */
-         cGen(p3);
          currentLoc = emitSkip(0) ;
-         emitBackup(savedLoc2) ;
+         emitBackup(g->loc2) ;
          emitRM_Abs("LDA",pc,currentLoc,"jmp to end") ;
          emitRestore() ;
          if (TraceCode)  emitComment("<- if") ;
          break; /* if_k */
-
       case IterK:
-         if (TraceCode) emitComment("-> iter") ;
-         p1 = tree->child[0] ;
-         p2 = tree->child[1] ;
-         savedLoc1 = emitSkip(0);
-         emitComment("repeat: jump after body comes back here");
-         /* generate code for test */
-         cGen(p1);
-         savedLoc2 = emitSkip(1);
-         /* generate code for body */
-         cGen(p2);
-         emitRM_Abs("LDA",pc,savedLoc1,"repeat: go for test");
+         emitRM_Abs("LDA",pc,g->loc1,"repeat: go for test");
          currentLoc = emitSkip(0);
-         emitBackup(savedLoc2);
-         emitRM_Abs("JEQ",ac,currentLoc,"repeat end");
+         emitBackup(g->loc2);
+         emitRM_Abs(g->jump,ac,currentLoc,"repeat end");
          emitRestore();
          if (TraceCode)  emitComment("<- repeat") ;
          break; /* repeat */
       case RetK:
-         if (TraceCode) emitComment("-> return");
-         /* not void return case */
-         if (tree->child[0] != NULL) {
-           cGen(tree->child[0]);
-         }
          afterFuncDecl();
          if (TraceCode) emitComment("<- return");
          break;
       default:
          break;
     }
-} /* genStmt */
+} /* genStmtEnd */
 
-/* Procedure genExp generates code at an expression node */
-static void genExp( TreeNode * tree)
-{ BucketList l;
-  TreeNode * p1, * p2;
+/* registers for expression temporaries,
+ * in the order genReg allocates them
+ */
+#define NUM_TMP_REGS 3
+static int tmpReg[NUM_TMP_REGS] = { ac, ac1, ac2 };
+
+/* Function isPure tells whether expression tree
+ * has no calls or assignments, so its temporaries
+ * may live in registers and its operands may be
+ * evaluated in any order
+ */
+static int isPure( TreeNode * tree)
+{ switch (tree->kind.exp) {
+    case ConstK :
+    case IdK :
+      return TRUE;
+    case ArrIdK :
+      return isPure(tree->child[0]);
+    case OpK :
+      return isPure(tree->child[0]) && isPure(tree->child[1]);
+    default:
+      return FALSE;
+  }
+} /* isPure */
+
+/* Function regNeed returns the Sethi-Ullman number
+ * of pure expression tree: the number of registers
+ * needed to evaluate it without spilling
+ */
+static int regNeed( TreeNode * tree)
+{ int n1, n2;
   switch (tree->kind.exp) {
+    case ArrIdK :
+      /* an array parameter needs a 2nd register
+       * for its address */
+      n1 = regNeed(tree->child[0]);
+      return n1 > 2 ? n1 : 2;
+    case OpK :
+      n1 = regNeed(tree->child[0]);
+      n2 = regNeed(tree->child[1]);
+      if (n1 == n2) return n1+1;
+      return n1 > n2 ? n1 : n2;
+    default:
+      return 1;
+  }
+} /* regNeed */
+
+/* Procedure varLoc sets off(base) to the location
+ * of variable tree, using the binding left by
+ * buildSymtab; for an array parameter that
+ * location holds the array's address
+ */
+static BucketList varLoc( TreeNode * tree, int * base, int * off)
+{ BucketList l = tree->sym;
+  if (tree->scope->nested_level == 0) {
+    *base = gp;
+    *off = l->memloc;
+  }
+  else if (l->i_type == ParamVar) {
+    *base = fp;
+    *off = 1+1+l->param_opt;
+  }
+  else {
+    *base = fp;
+    *off = -(l->memloc);
+  }
+  return l;
+} /* varLoc */
 
+/* Procedure relocGlobal marks the instruction
+ * just emitted, whose displacement holds the
+ * location of variable tree, for the linker
+ * if tree is a global of a unit
+ */
+static void relocGlobal( TreeNode * tree)
+{ if (CompileOnly && (tree->scope->nested_level == 0))
+    emitReloc(unitSymbol(tree->sym), RelocData);
+} /* relocGlobal */
+
+/* Procedure genId loads the value of variable
+ * tree into register r; the value of an array
+ * is its address
+ */
+static void genId( TreeNode * tree, int r)
+{ BucketList l;
+  int base, off;
+  l = varLoc(tree, &base, &off);
+  if (l->type != IntegerArray)
+    emitRM("LD",r,off,base,"load id value");
+  else if (l->i_type == ParamVar)
+    emitRM("LD",r,off,base,"load param array address");
+  else
+    emitRM("LDA",r,off,base,"load array address");
+  relocGlobal(tree);
+} /* genId */
+
+/* Function genElemAddr turns the index of array
+ * element tree, held in tmpReg[i], into a base
+ * address in tmpReg[i] and returns the element's
+ * offset from it. Arrays grow downwards; an array
+ * parameter also uses tmpReg[i+1]
+ */
+static int genElemAddr( TreeNode * tree, int i)
+{ BucketList l;
+  int base, off;
+  int r = tmpReg[i];
+  l = varLoc(tree, &base, &off);
+  if (l->i_type == ParamVar) {
+    emitRM("LD",tmpReg[i+1],off,base,"load param array address");
+    emitRO("SUB",r,tmpReg[i+1],r,"array element address");
+    return 0;
+  }
+  emitRO("SUB",r,base,r,"array element address");
+  return off;
+} /* genElemAddr */
+
+/* condTree is the comparison that genCond is
+ * generating; it leaves only the difference of
+ * its operands in ac for the branch
+ */
+static TreeNode * condTree = NULL;
+
+/* Procedure genOp emits r = s op t for operator
+ * node tree; for condTree it stops after the SUB
+ */
+static void genOp( TreeNode * tree, int r, int s, int t)
+{ TokenType op = tree->attr.op;
+  if (tree == condTree) {
+    emitRO("SUB",r,s,t,"op: compare");
+    return;
+  }
+  switch (op) {
+    case PLUS :
+      emitRO("ADD",r,s,t,"op +");
+      return;
+    case MINUS :
+      emitRO("SUB",r,s,t,"op -");
+      return;
+    case TIMES :
+      emitRO("MUL",r,s,t,"op *");
+      return;
+    case OVER :
+      emitRO("DIV",r,s,t,"op /");
+      return;
+    case LT :
+      emitRO("SUB",r,s,t,"op <") ;
+      emitRM("JLT",r,2,pc,"br if true") ;
+      break;
+    case LE :
+      emitRO("SUB",r,s,t,"op <=") ;
+      emitRM("JLE",r,2,pc,"br if true");
+      break;
+    case GT :
+      emitRO("SUB",r,s,t,"op >") ;
+      emitRM("JGT",r,2,pc,"br if true");
+      break;
+    case GE :
+      emitRO("SUB",r,s,t,"op >=") ;
+      emitRM("JGE",r,2,pc,"br if true");
+      break;
+    case EQ :
+      emitRO("SUB",r,s,t,"op ==") ;
+      emitRM("JEQ",r,2,pc,"br if true");
+      break;
+    case NE :
+      emitRO("SUB",r,s,t,"op !=") ;
+      emitRM("JNE",r,2,pc,"br if true");
+      break;
+    default:
+      emitComment("BUG: Unknown operator");
+      return;
+  }
+  emitRM("LDC",r,0,0,"false case") ;
+  emitRM("LDA",pc,1,pc,"unconditional jmp") ;
+  emitRM("LDC",r,1,0,"true case") ;
+} /* genOp */
+
+/* Procedure genReg generates code for pure
+ * expression tree into tmpReg[i], using only
+ * tmpReg[i..]. The operand needing more registers
+ * goes first (Sethi-Ullman); when neither fits in
+ * the registers left the left one is spilled to
+ * the sp stack. genReg is only called with two
+ * registers left, or for a tree needing one
+ */
+static void genReg( TreeNode * tree, int i)
+{ TreeNode * p1, * p2;
+  int r = tmpReg[i];
+  int left = NUM_TMP_REGS-i;
+  int n1, n2, d;
+  switch (tree->kind.exp) {
     case ConstK :
-      if (TraceCode) emitComment("-> Const") ;
-      /* gen code to load integer constant using LDC */
-      emitRM("LDC",ac,tree->attr.val,0,"load const");
-      if (TraceCode)  emitComment("<- Const") ;
-      break; /* ConstK */
+      emitRM("LDC",r,tree->attr.val,0,"load const");
+      break;
     case IdK :
-      if (TraceCode) emitComment("-> Id") ;
-      emitHelper("LD",tree, "load Id");
-      if (TraceCode)  emitComment("<- Id") ;
-      break; /* IdK */
+      genId(tree, r);
+      break;
     case ArrIdK :
       if (TraceCode) emitComment("-> ArrId");
-      emitHelper("LD", tree, "load ArrId"); 
+      genReg(tree->child[0], i);
+      d = genElemAddr(tree, i);
+      emitRM("LD",r,d,r,"load ArrId");
+      relocGlobal(tree);
+      if (TraceCode) emitComment("<- ArrId");
+      break;
+    case OpK :
+      if (TraceCode) emitComment("-> Op") ;
+      p1 = tree->child[0];
+      p2 = tree->child[1];
+      n1 = regNeed(p1);
+      n2 = regNeed(p2);
+      if (n1 >= n2 && n2 < left) {
+        genReg(p1, i);
+        genReg(p2, i+1);
+        genOp(tree, r, r, tmpReg[i+1]);
+      }
+      else if (n2 > n1 && n1 < left) {
+        genReg(p2, i);
+        genReg(p1, i+1);
+        genOp(tree, r, tmpReg[i+1], r);
+      }
+      else {
+        genReg(p1, i);
+        spController("ST",r,"op: push left");
+        genReg(p2, i);
+        spController("LD",tmpReg[i+1],"op: load left");
+        genOp(tree, r, tmpReg[i+1], r);
+      }
+      if (TraceCode)  emitComment("<- Op") ;
+      break;
+    default:
+      break;
+  }
+} /* genReg */
+
+/* Function falseJump returns the jump taken when
+ * comparison op is false, applied to the difference
+ * of its operands, or NULL if op is no comparison
+ */
+static char * falseJump( TokenType op)
+{ switch (op) {
+    case LT : return "JGE";
+    case LE : return "JGT";
+    case GT : return "JLE";
+    case GE : return "JLT";
+    case EQ : return "JNE";
+    case NE : return "JEQ";
+    default : return NULL;
+  }
+} /* falseJump */
+
+/* Function genCond generates code for the test of
+ * an if or while and returns the jump, on ac, to
+ * take when it is false. A comparison branches on
+ * the difference of its operands instead of making
+ * a 0/1 value first
+ */
+static char * genCond( TreeNode * tree)
+{ char * jump = NULL;
+  if ((tree->nodekind == ExpK) && (tree->kind.exp == OpK))
+    jump = falseJump(tree->attr.op);
+  condTree = (jump != NULL) ? tree : NULL;
+  genExp(tree);
+  condTree = NULL;
+  return (jump != NULL) ? jump : "JEQ";
+} /* genCond */
+
+/* Procedure genExp generates code at an expression
+ * node, leaving its value in ac. Pure expressions
+ * go to genReg; a call clobbers every register, so
+ * around calls and assignments temporaries are kept
+ * on the sp stack
+ */
+static void genExp( TreeNode * tree)
+{ TreeNode * p1, * p2;
+  int base, off, d;
+  if (isPure(tree)) {
+    genReg(tree, 0);
+    return;
+  }
+  switch (tree->kind.exp) {
+
+    case ArrIdK :
+      if (TraceCode) emitComment("-> ArrId");
+      genExp(tree->child[0]);
+      d = genElemAddr(tree, 0);
+      emitRM("LD",ac,d,ac,"load ArrId");
+      relocGlobal(tree);
       if (TraceCode) emitComment("<- ArrId");
       break;
     case CallK :
@@ -139,91 +466,59 @@ static void genExp( TreeNode * tree)
          p1 = tree->child[0];
          p2 = tree->child[1];
          /* gen code for ac = left arg */
-         cGen(p1);
-         /* gen code to push left operand */
-         spController("ST",ac,"op: push left");
-         /* gen code for ac = right operand */
-         cGen(p2);
-         /* now load left operand */
-         spController("LD",ac1,"op: load left");
-         switch (tree->attr.op) {
-            case PLUS :
-               emitRO("ADD",ac,ac1,ac,"op +");
-               break;
-            case MINUS :
-               emitRO("SUB",ac,ac1,ac,"op -");
-               break;
-            case TIMES :
-               emitRO("MUL",ac,ac1,ac,"op *");
-               break;
-            case OVER :
-               emitRO("DIV",ac,ac1,ac,"op /");
-               break;
-            case LT :
-               emitRO("SUB",ac,ac1,ac,"op <") ;
-               emitRM("JLT",ac,2,pc,"br if true") ;
-               emitRM("LDC",ac,0,ac,"false case") ;
-               emitRM("LDA",pc,1,pc,"unconditional jmp") ;
-               emitRM("LDC",ac,1,ac,"true case") ;
-               break;
-            case LE:
-               emitRO("SUB",ac,ac1,ac,"op ==") ;
-               emitRM("JLE",ac,2,pc,"br if true");
-               emitRM("LDC",ac,0,ac,"false case") ;
-               emitRM("LDA",pc,1,pc,"unconditional jmp") ;
-               emitRM("LDC",ac,1,ac,"true case") ;
-               break;
-            case GT:
-               emitRO("SUB",ac,ac1,ac,"op ==") ;
-               emitRM("JGT",ac,2,pc,"br if true");
-               emitRM("LDC",ac,0,ac,"false case") ;
-               emitRM("LDA",pc,1,pc,"unconditional jmp") ;
-               emitRM("LDC",ac,1,ac,"true case") ;
-               break;
-            case GE:
-               emitRO("SUB",ac,ac1,ac,"op ==") ;
-               emitRM("JGE",ac,2,pc,"br if true");
-               emitRM("LDC",ac,0,ac,"false case") ;
-               emitRM("LDA",pc,1,pc,"unconditional jmp") ;
-               emitRM("LDC",ac,1,ac,"true case") ;
-               break;
-            case EQ :
-               emitRO("SUB",ac,ac1,ac,"op ==") ;
-               emitRM("JEQ",ac,2,pc,"br if true");
-               emitRM("LDC",ac,0,ac,"false case") ;
-               emitRM("LDA",pc,1,pc,"unconditional jmp") ;
-               emitRM("LDC",ac,1,ac,"true case") ;
-               break;
-            case NE:
-               emitRO("SUB",ac,ac1,ac,"op !=") ;
-               emitRM("JNE",ac,2,pc,"br if true");
-               emitRM("LDC",ac,0,ac,"false case") ;
-               emitRM("LDA",pc,1,pc,"unconditional jmp") ;
-               emitRM("LDC",ac,1,ac,"true case") ;
-               break;
-            default:
-               emitComment("BUG: Unknown operator");
-               break;
-         } /* case op */
+         genExp(p1);
+         if (isPure(p2) && regNeed(p2) < NUM_TMP_REGS) {
+           /* right operand in ac1 */
+           genReg(p2, 1);
+           genOp(tree, ac, ac, ac1);
+         }
+         else {
+           /* gen code to push left operand */
+           spController("ST",ac,"op: push left");
+           /* gen code for ac = right operand */
+           genExp(p2);
+           /* now load left operand */
+           spController("LD",ac1,"op: load left");
+           genOp(tree, ac, ac1, ac);
+         }
          if (TraceCode)  emitComment("<- Op") ;
          break; /* OpK */
     case AssignK:
       if (TraceCode) emitComment("-> Assign");
-      /* do something */
       p1 = tree->child[0];
       p2 = tree->child[1];
 
-      /* get l-val's address */
-      emitHelper("LDA", p1, "AssignK's l-value");
-      /* save l-val in sp stack */
-      spController("ST",ac,"save l-val in sp stack");
-      /* get r-val */
-      cGen(p2);
-
-      /* restore l-val in sp stack */
-      spController("LD",ac1,"load l-val in sp stack");
-      /* store r-val in l-val */
-      emitRM("ST", ac, 0, ac1, "Assignment is done"); 
+      if (p1->kind.exp == IdK) {
+        /* get r-val */
+        genExp(p2);
+        varLoc(p1, &base, &off);
+        emitRM("ST",ac,off,base,"Assignment is done");
+        relocGlobal(p1);
+      }
+      else if (isPure(p1->child[0])
+               && regNeed(p1->child[0]) < NUM_TMP_REGS) {
+        /* get r-val, then l-val's address in ac1 */
+        genExp(p2);
+        genReg(p1->child[0], 1);
+        d = genElemAddr(p1, 1);
+        emitRM("ST",ac,d,ac1,"Assignment is done");
+        relocGlobal(p1);
+      }
+      else {
+        /* get l-val's address */
+        genExp(p1->child[0]);
+        d = genElemAddr(p1, 0);
+        emitRM("LDA",ac,d,ac,"AssignK's l-value");
+        relocGlobal(p1);
+        /* save l-val in sp stack */
+        spController("ST",ac,"save l-val in sp stack");
+        /* get r-val */
+        genExp(p2);
+        /* restore l-val in sp stack */
+        spController("LD",ac1,"load l-val in sp stack");
+        /* store r-val in l-val */
+        emitRM("ST", ac, 0, ac1, "Assignment is done");
+      }
       if (TraceCode) emitComment("<- Assign");
       break;
     default:
@@ -231,16 +526,15 @@ static void genExp( TreeNode * tree)
   }
 } /* genExp */
 
-/* This procedure control tree
- * that kind.decl is Func
- * so don't need to use switch case phrase
+/* Procedure genFuncStart starts the code of a
+ * function declaration with a body
+ * (tree->child[2]); genFuncEnd ends it
  */
-static void getFunc( TreeNode * tree) {
-  int loc;
-  BucketList l;
+static void genFuncStart( TreeNode * tree) {
   Scope scope;
-  l = st_lookup(sc_top(), tree->attr.name);
   scope = search_in_all_scope(tree->attr.name);
+  emitFunc(tree->attr.name);
+  if (CompileOnly) unitDefine(st_lookup_function(tree->attr.name));
 
   if (strcmp("main", tree->attr.name)) {
     beforeFuncDecl(tree->attr.name);
@@ -251,13 +545,9 @@ static void getFunc( TreeNode * tree) {
     emitRM("LDC",ac,scope->mem_size,0,"set main function's local var offset");
     emitRO("SUB",sp,fp,ac,"set main function sp");
   }
+}
 
-  /* tree->child[0] : type
-   * tree->child[1] : parameters
-   * tree->child[2] : body
-   */
-  cGen(tree->child[2]);
-
+static void genFuncEnd( TreeNode * tree) {
   if (strcmp("main", tree->attr.name)) {
     afterFuncDecl();
   }
@@ -268,25 +558,29 @@ void makeBuiltInFunc() {
   BucketList l;
   
   /* input function */
+  emitBuiltin("input");
   beforeFuncDecl("input");
   emitRO("IN",ac,0,0,"read integer value");
   afterFuncDecl();
   
 
   /* output function */
+  emitBuiltin("output");
   beforeFuncDecl("output");
   emitRO("LD",ac,2,fp,"load output param");
   emitRO("OUT",ac,0,0,"write integer value");
   afterFuncDecl();
+  emitFunc(NULL);
 }
 
 /* decl part */
 void beforeFuncDecl(char *name) {
   BucketList l;
   int loc = emitSkip(0);
-  emitRM("LDC", ac, loc+3, 0, "get function location");
-  l = st_lookup(sc_top(), name);
+  emitRM_Loc("LDC", ac, loc+3, "get function location");
+  l = st_lookup(sc_top(), st_intern(name));
   emitRM("ST", ac, l->memloc, gp, "set function pointer"); 
+  if (CompileOnly) emitReloc(unitSymbol(l), RelocData);
   /* to do not execute function - change pc val */
   functionSkip = emitSkip(1);
 }
@@ -311,7 +605,7 @@ void afterFuncDecl() {
   /* set function skip command */
   loc = emitSkip(0);
   emitBackup(functionSkip);
-  emitRM("LDC",pc,loc,0,"function skip");
+  emitRM_Loc("LDC",pc,loc,"function skip");
   emitRestore();
 }
 
@@ -329,7 +623,7 @@ void beforeFuncCall(TreeNode *tree) {
   BucketList l;
   params = tree->child[0];
 
-  scope = search_in_all_scope(tree->attr.name);
+  scope = tree->sym->scope;
   
   param_num = scope->max_param_num; 
   mem_size = scope->mem_size;
@@ -339,7 +633,7 @@ void beforeFuncCall(TreeNode *tree) {
   /* save return location */
   loc = emitSkip(0);
 
-  emitRM("LDC",ac1,loc+10,0,"set return addr val");
+  emitRM_Loc("LDC",ac1,loc+10,"set return addr val");
   emitRM("ST",ac1,-(param_num),sp, "set return address");
   /* control linking ..... */
   emitRM("LDA",ac1,0,fp,"get old fp");
@@ -348,21 +642,35 @@ void beforeFuncCall(TreeNode *tree) {
   emitRM("ST",ac1,-(param_num+2),sp, "set control link2(old sp)");
   /* fp move */
   emitRM("LDA",fp,-(param_num+1),sp,"get new fp");
-  /* set new mp */
-  emitRM("LDC",ac,scope->mem_size,0,"set mp offset");
+  /* set new mp; the frame of a function
+   * of another unit is left to the linker */
+  l = tree->sym;
+  if (CompileOnly && ! l->defined) {
+    emitRM("LDC",ac,0,0,"set mp offset");
+    emitReloc(unitSymbol(l), RelocFrame);
+  }
+  else
+    emitRM("LDC",ac,scope->mem_size,0,"set mp offset");
   emitRO("SUB",sp,fp,ac,"get new mp");
   /* pc mov to function call */
-  l = st_lookup(sc_top(), tree->attr.name);
   emitRM("LD",pc,l->memloc,gp,"moving pc");
+  if (CompileOnly) emitReloc(unitSymbol(l), RelocData);
 }
 
 void setParamReverseOrder(TreeNode *tree, int param_num, int offset) {
-  if (tree == NULL) {
-    return ;
+  TreeNode * t;
+  int n = 0;
+  /* the arguments are evaluated last to first: walk
+   * the list reversed in place, then turn it back
+   */
+  for (t = tree; t != NULL; t = t->sibling) n++;
+  tree = reverseList(tree);
+  for (t = tree; t != NULL; t = t->sibling) {
+    n--;
+    genExp(t);
+    emitRM("ST",ac,-(param_num-1)+offset+n,sp, "save param in temp");
   }
-  setParamReverseOrder(tree->sibling, param_num, offset+1);
-  genExp(tree);
-  emitRM("ST",ac,-(param_num-1)+offset,sp, "save param in temp");
+  reverseList(tree);
 }
 
 /* This procedure is used for
@@ -380,145 +688,99 @@ void spController(char* c, int r, char* comment) {
   }
 }
 
-/* This procedure is used for 
- * IdK, IdArrK, AssignK l-val 
- * to reduce code length and increase readability.
- * LD and LDA use only
+/* Function hasCode tells whether cGen generates
+ * code for the children of declaration tree: a
+ * prototype has none, and main is held back
+ * until every other function has set its
+ * function pointer, since a prototype lets main
+ * call a function defined after it
  */
-void emitHelper(char* c, TreeNode* tree, char* comment) {
-  BucketList l;
-  int is_global = 0; /* 0: false, 1: true */
-  int base = fp;
-  char* name;
-  int is_param = 0;
-  int is_array = 0;
-
-  /* name setting */
-  if (is_array) {
-    name = tree->attr.arr.name;
-  }
-  else {
-    name = tree->attr.name;
+static int hasCode( TreeNode * tree) {
+  if ((tree->kind.decl != FuncK) || (tree->child[2] == NULL))
+    return FALSE;
+  if ((strcmp("main", tree->attr.name) == 0) && ! genMain) {
+    mainDecl = tree;
+    return FALSE;
   }
-  l = st_lookup(sc_top(), name);
-  is_global = is_in_global_scope(l);
-  is_param = (l->i_type == ParamVar);
-  is_array = (l->type == IntegerArray);
-
-  /* cases
-   * 1) global - var, arr
-   * 2) local - var, arr
-   * 3) param - var, arr
-   */
-  /* base setting if not registed addr -> saved in ac1 */
-  /* global case */
-  if (is_global) {
-    if (is_array)
-      emitRM("LDA",ac1,l->memloc,gp,"get base addr global array");
-    else
-      emitRM("LDA",ac1,0,gp,"get base addr global var");
-  }
-  /* param case */
-  else if (is_param) {
-    if (is_array)
-      emitRM("LD",ac1,(1+1+l->param_opt),base,"get base addr param array");
-    else 
-      emitRM("LDA",ac1,0,fp,"get base addr param var");
-  }
-  /* local case */
-  else {
-    if (is_array)
-      emitRM("LDA",ac1,-(l->memloc),fp,"get base addr local array");
-    else 
-      emitRM("LDA",ac1,0,fp,"get base addr local var");
-  }
-  
-  /* offset setting saved in ac */
-  /* global case */
-  if (is_global) {
-    if (is_array) {
-      if (tree->kind.exp == ArrIdK) {
-        spController("ST",ac1,"keep it plz for array index calc");
-        cGen(tree->child[0]);
-        spController("LD",ac1,"get again");
-        emitRO("SUB",ac,zero,ac,"- offset setting global array");
-      }
-    }
-    else 
-      emitRM("LDC",ac,l->memloc,0,"get addr offset global var");
-  }
-  /* param case */
-  else if (is_param) {
-    if (is_array) {
-      if (tree->kind.exp == ArrIdK) {
-        spController("ST",ac1,"keep it plz for array index calc");
-        cGen(tree->child[0]);
-        spController("LD",ac1,"get again");
-        emitRO("SUB",ac,zero,ac,"- offset setting param array");
-      }
-    }
-    else {
-      emitRM("LDC",ac,1+1+l->param_opt,0,"get addr offset param var");
-    }
+  return TRUE;
+}
+
+/* Procedure genPre is cGen's preorder hook: it
+ * pushes the node's state and generates the
+ * code before its children; an expression is
+ * generated here as a whole
+ */
+static void genPre( TreeNode * tree) {
+  GenState * g;
+  if (++genTop == genSize) {
+    genSize = (genSize == 0) ? 64 : 2*genSize;
+    genStack = realloc(genStack, genSize*sizeof(GenState));
   }
-  /* local case */
-  else {
-    if (is_array) {
-      if (tree->kind.exp == ArrIdK) {
-        spController("ST",ac1,"keep it plz for array index calc");
-        cGen(tree->child[0]);
-        spController("LD",ac1,"get again");
-        emitRO("SUB",ac,zero,ac,"- offset setting local array");
-      }
-    }
-    else
-      emitRM("LDC",ac,-(l->memloc),0,"get addr offset local var");
+  g = &genStack[genTop];
+  g->line = emitLine(tree->lineno);
+  switch (tree->nodekind) {
+    case StmtK:
+      genStmtStart(tree,g);
+      break;
+    case ExpK:
+      genExp(tree);
+      break;
+    case DeclK:
+      if (hasCode(tree)) genFuncStart(tree);
+      break;
+    default:
+      break;
   }
-  
-  if (is_array && tree->kind.exp !=ArrIdK) {
-    emitRM("LDA",ac,0,ac1,"get address that we want");
-    return ;
+}
+
+/* Function genChild is cGen's hook before
+ * child i: it tells whether the child gets code
+ */
+static int genChild( TreeNode * tree, int i) {
+  switch (tree->nodekind) {
+    case StmtK:
+      return genStmtChild(tree,i,&genStack[genTop]);
+    case DeclK:
+      /* tree->child[0] : type
+       * tree->child[1] : parameters
+       * tree->child[2] : body
+       */
+      return (i == 2) && hasCode(tree);
+    default:
+      return FALSE;
   }
+}
 
-  /* get addr that we targeting: base- ac1, offset- ac */
-  emitRO("ADD",ac,ac,ac1,"get address that we want");
-  emitRM(c,ac,0,ac,comment);
+/* Procedure genPost is cGen's postorder hook */
+static void genPost( TreeNode * tree) {
+  GenState * g = &genStack[genTop];
+  switch (tree->nodekind) {
+    case StmtK:
+      genStmtEnd(tree,g);
+      break;
+    case DeclK:
+      if (hasCode(tree)) genFuncEnd(tree);
+      break;
+    default:
+      break;
+  }
+  emitLine(g->line);
+  genTop--;
 }
 
-/* Procedure cGen recursively generates code by
- * tree traversal
+/* Procedure cGen generates code for tree and its
+ * siblings by walkChildren, so nested statements
+ * do not grow the C stack
  */
 static void cGen( TreeNode * tree) {
-  if (tree != NULL)
-  { switch (tree->nodekind) {
-      case StmtK:
-        genStmt(tree);
-        break;
-      case ExpK:
-        genExp(tree);
-        break;
-      case DeclK:
-        if (tree->kind.decl == FuncK) {
-          getFunc(tree);
-        }
-        break;
-      default:
-        break;
-    }
-    cGen(tree->sibling);
-  }
+  walkChildren(tree,genPre,genChild,genPost);
 }
 
-/**********************************************/
-/* the primary function of the code generator */
-/**********************************************/
-/* Procedure codeGen generates code to a code
- * file by traversal of the syntax tree. The
- * second parameter (codefile) is the file name
- * of the code file, and is used to print the
- * file name as a comment in the code file
+/* Procedure genPrelude emits the header comments,
+ * the standard prelude and the built-in functions
+ * of the program in code file codefile
  */
-void codeGen(TreeNode * syntaxTree, char * codefile)
+void genPrelude(char * codefile)
 {  char * s = malloc(strlen(codefile)+7);
    strcpy(s,"File: ");
    strcat(s,codefile);
@@ -535,12 +797,51 @@ void codeGen(TreeNode * syntaxTree, char * codefile)
 
    /* built-in function declaration : input() and output(arg) */
    makeBuiltInFunc();
+}
+
+/* Procedure genEnd ends the program */
+void genEnd(void)
+{  emitFunc(NULL);
+   emitComment("End of execution.");
+   emitRO("HALT",0,0,0,"");
+}
 
+/**********************************************/
+/* the primary function of the code generator */
+/**********************************************/
+/* Procedure codeGen generates code to a code
+ * file by traversal of the syntax tree. The
+ * second parameter (codefile) is the file name
+ * of the code file, and is used to print the
+ * file name as a comment in the code file. With
+ * CompileOnly the code file gets a unit object
+ * (see link.h) instead
+ */
+void codeGen(TreeNode * syntaxTree, char * codefile)
+{  TreeNode * next;
+   if (! CompileOnly) genPrelude(codefile);
    /* scope : set global scope */
    sc_init();
    /* generate code for TINY program */
+   mainDecl = NULL;
    cGen(syntaxTree);
+   if (mainDecl != NULL) {
+     /* main alone, without its siblings */
+     next = mainDecl->sibling;
+     mainDecl->sibling = NULL;
+     genMain = TRUE;
+     cGen(mainDecl);
+     genMain = FALSE;
+     mainDecl->sibling = next;
+   }
    /* finish */
-   emitComment("End of execution.");
-   emitRO("HALT",0,0,0,"");
+   if (CompileOnly) emitFunc(NULL);
+   else genEnd();
+   if (Peephole) peephole();
+   if (CompileOnly) {
+     writeUnit(code,codefile);
+     return;
+   }
+   emitFlush();
+   if (SizeReport) emitSizeReport(listing);
 }
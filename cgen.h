@@ -14,11 +14,21 @@
  * file by traversal of the syntax tree. The
  * second parameter (codefile) is the file name
  * of the code file, and is used to print the
- * file name as a comment in the code file
+ * file name as a comment in the code file. With
+ * CompileOnly the code file gets a unit object
+ * (see link.h) instead
  */
 void codeGen(TreeNode * syntaxTree, char * codefile);
 
-void emitHelper(char* c, TreeNode *tree, char* comment);
+/* Procedure genPrelude emits the header comments,
+ * the standard prelude and the built-in functions
+ * of the program in code file codefile
+ */
+void genPrelude(char * codefile);
+
+/* Procedure genEnd ends the program */
+void genEnd(void);
+
 void makeBuiltInFunc();
 
 void setParamReverseOrder(TreeNode *tree, int param_num, int offset);
@@ -9,6 +9,7 @@
 
 #include "globals.h"
 #include "util.h"
+#include "symtab.h"
 #include "scan.h"
 #include "parse.h"
 
@@ -33,16 +34,14 @@ static int yylex(void);
 
 %% /* Grammar for TINY */
 program     : decl_list
-                 { savedTree = $1;}
+                 { savedTree = reverseList($1);}
             ;
 decl_list   : decl_list decl
-                 { YYSTYPE t = $1;
-                   if (t != NULL)
-                   { while (t->sibling != NULL)
-                        t = t->sibling;
-                     t->sibling = $2;
-                     $$ = $1; }
-                     else $$ = $2;
+                 { /* built backwards, see reverseList */
+                   if ($2 != NULL)
+                   { $2->sibling = $1;
+                     $$ = $2; }
+                   else $$ = $1;
                  }
             | decl  { $$ = $1; }
             ;
@@ -50,7 +49,7 @@ decl        : var_decl  { $$ = $1; }
             | fun_decl  { $$ = $1; }
             ;
 saveName    : ID
-                 { savedName = copyString(tokenString);
+                 { savedName = st_intern(tokenString);
                    savedLineNo = lineno;
                  }
             ;
@@ -85,32 +84,37 @@ type_spec   : INT
                    $$->type = Void;
                  }
             ;
-fun_decl    : type_spec saveName {
+fun_decl    : fun_head comp_stmt
+                 { $$ = $1;
+                   $$->child[2] = $2; /* body */
+                 }
+            | fun_head SEMI
+                 { $$ = $1; /* a prototype: no body */
+                 }
+            ;
+fun_head    : type_spec saveName {
                    $$ = newDeclNode(FuncK);
                    $$->lineno = lineno;
                    $$->attr.name = savedName;
                  }
-              LPAREN params RPAREN comp_stmt
+              LPAREN params RPAREN
                  {
                    $$ = $3;
                    $$->child[0] = $1; /* type */
                    $$->child[1] = $5;    /* parameters */
-                   $$->child[2] = $7; /* body */
                  }
             ;
-params      : param_list  { $$ = $1; }
+params      : param_list  { $$ = reverseList($1); }
             | VOID
                  { $$ = newTypeNode(TypeNameK);
                    $$->attr.type = VOID;
                  }
 param_list  : param_list COMMA param
-                 { YYSTYPE t = $1;
-                   if (t != NULL)
-                   { while (t->sibling != NULL)
-                        t = t->sibling;
-                     t->sibling = $3;
-                     $$ = $1; }
-                     else $$ = $3; 
+                 { /* built backwards, see reverseList */
+                   if ($3 != NULL)
+                   { $3->sibling = $1;
+                     $$ = $3; }
+                   else $$ = $1;
                  }
             | param { $$ = $1; };
 param       : type_spec saveName
@@ -128,29 +132,25 @@ param       : type_spec saveName
             ;
 comp_stmt   : LCURLY local_decls stmt_list RCURLY
                  { $$ = newStmtNode(CompK);
-                   $$->child[0] = $2; /* local variable declarations */
-                   $$->child[1] = $3; /* statements */
+                   $$->child[0] = reverseList($2); /* local variable declarations */
+                   $$->child[1] = reverseList($3); /* statements */
                  }
             ;
 local_decls : local_decls var_decl
-                 { YYSTYPE t = $1;
-                   if (t != NULL)
-                   { while (t->sibling != NULL)
-                        t = t->sibling;
-                     t->sibling = $2;
-                     $$ = $1; }
-                     else $$ = $2;
+                 { /* built backwards, see reverseList */
+                   if ($2 != NULL)
+                   { $2->sibling = $1;
+                     $$ = $2; }
+                   else $$ = $1;
                  }
             | /* empty */ { $$ = NULL; }
             ;
 stmt_list   : stmt_list stmt
-                 { YYSTYPE t = $1;
-                   if (t != NULL)
-                   { while (t->sibling != NULL)
-                        t = t->sibling;
-                     t->sibling = $2;
-                     $$ = $1; }
-                     else $$ = $2;
+                 { /* built backwards, see reverseList */
+                   if ($2 != NULL)
+                   { $2->sibling = $1;
+                     $$ = $2; }
+                   else $$ = $1;
                  }
             | /* empty */ { $$ = NULL; }
             ;
@@ -279,17 +279,15 @@ call        : saveName {
                    $$->child[0] = $4;
                  }
             ;
-args        : arg_list { $$ = $1; }
+args        : arg_list { $$ = reverseList($1); }
             | /* empty */ { $$ = NULL; }
             ;
 arg_list    : arg_list COMMA exp
-                 { YYSTYPE t = $1;
-                   if (t != NULL)
-                   { while (t->sibling != NULL)
-                        t = t->sibling;
-                     t->sibling = $3;
-                     $$ = $1; }
-                     else $$ = $3;
+                 { /* built backwards, see reverseList */
+                   if ($3 != NULL)
+                   { $3->sibling = $1;
+                     $$ = $3; }
+                   else $$ = $1;
                  }
             | exp { $$ = $1; }
             ;
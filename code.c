@@ -6,8 +6,10 @@
 /* Kenneth C. Louden                                */
 /****************************************************/
 
+#include <stdarg.h>
 #include "globals.h"
 #include "code.h"
+#include "tmobj.h"
 
 /* TM location number for current instruction emission */
 static int emitLoc = 0 ;
@@ -17,11 +19,119 @@ static int emitLoc = 0 ;
    emitBackup, and emitRestore */
 static int highEmitLoc = 0;
 
-/* Procedure emitComment prints a comment line 
+/* the instruction buffer, indexed by location;
+   backpatching overwrites a slot */
+static TMInstr * codeBuf = NULL;
+static int codeCap = 0;
+
+/* comment lines, each printed before the
+   instruction at loc */
+typedef struct
+   { int loc;
+     int text; /* offset in textPool */
+   } CommentRec;
+
+static CommentRec * comments = NULL;
+static int numComments = 0;
+static int commentCap = 0;
+
+/* comment strings are copied into one pool */
+static char * textPool = NULL;
+static int textLen = 0;
+static int textCap = 0;
+
+static char * opCodes[] = TMOBJ_OPCODES;
+
+/* source line and function (textPool offset)
+   recorded with each instruction */
+static int curLine = 0;
+static int curFunc = -1;
+
+/* the functions named by emitFunc, in order
+   (so by textPool offset), for emitSizeReport */
+typedef struct
+   { int text; /* offset in textPool */
+     int builtin;
+   } FuncRec;
+
+static FuncRec * funcs = NULL;
+static int numFuncs = 0;
+static int funcCap = 0;
+
+/* Function saveText copies s into textPool
+ * and returns its offset
+ */
+static int saveText( char * s )
+{ int n = strlen(s)+1;
+  int off = textLen;
+  if (textLen+n > textCap)
+  { while (textLen+n > textCap) textCap = textCap ? 2*textCap : 4096;
+    textPool = realloc(textPool,textCap);
+  }
+  memcpy(textPool+textLen,s,n);
+  textLen += n;
+  return off;
+} /* saveText */
+
+/* Function codeSlot returns the buffer slot
+ * for location loc, growing the buffer
+ */
+static TMInstr * codeSlot( int loc )
+{ if (loc >= codeCap)
+  { int i = codeCap;
+    while (loc >= codeCap) codeCap = codeCap ? 2*codeCap : 1024;
+    codeBuf = realloc(codeBuf,codeCap*sizeof(TMInstr));
+    for (; i < codeCap; i++) codeBuf[i].op = -1;
+  }
+  return &codeBuf[loc];
+} /* codeSlot */
+
+/* Function opNumber returns the opcode number
+ * of op (see tmobj.h)
+ */
+static int opNumber( char * op )
+{ int i = 0;
+  while ((i < TMOBJ_NUM_OPCODES) && (strcmp(opCodes[i],op) != 0))
+    i++;
+  if (i == TMOBJ_NUM_OPCODES)
+  { emitComment("BUG: unknown opcode");
+    i = 0;
+  }
+  return i;
+} /* opNumber */
+
+/* Procedure emitInstr stores an instruction at
+ * the current location and advances it
+ */
+static void emitInstr( int isRO, char *op, int a1, int a2, int a3, char *c)
+{ TMInstr * in = codeSlot(emitLoc);
+  in->op = opNumber(op);
+  in->isRO = isRO;
+  in->arg1 = a1;
+  in->arg2 = a2;
+  in->arg3 = a3;
+  in->comment = TraceCode ? saveText(c) : -1;
+  in->isLoc = FALSE;
+  in->line = curLine;
+  in->func = curFunc;
+  in->reloc = -1;
+  ++emitLoc;
+  if (highEmitLoc < emitLoc) highEmitLoc = emitLoc ;
+} /* emitInstr */
+
+/* Procedure emitComment prints a comment line
  * with comment c in the code file
  */
 void emitComment( char * c )
-{ if (TraceCode) fprintf(code,"* %s\n",c);}
+{ if (! TraceCode) return;
+  if (numComments == commentCap)
+  { commentCap = commentCap ? 2*commentCap : 1024;
+    comments = realloc(comments,commentCap*sizeof(CommentRec));
+  }
+  comments[numComments].loc = emitLoc;
+  comments[numComments].text = saveText(c);
+  numComments++;
+}
 
 /* Procedure emitRO emits a register-only
  * TM instruction
@@ -32,10 +142,7 @@ void emitComment( char * c )
  * c = a comment to be printed if TraceCode is TRUE
  */
 void emitRO( char *op, int r, int s, int t, char *c)
-{ fprintf(code,"%3d:  %5s  %d,%d,%d ",emitLoc++,op,r,s,t);
-  if (TraceCode) fprintf(code,"\t%s",c) ;
-  fprintf(code,"\n") ;
-  if (highEmitLoc < emitLoc) highEmitLoc = emitLoc ;
+{ emitInstr(TRUE,op,r,s,t,c);
 } /* emitRO */
 
 /* Procedure emitRM emits a register-to-memory
@@ -47,10 +154,7 @@ void emitRO( char *op, int r, int s, int t, char *c)
  * c = a comment to be printed if TraceCode is TRUE
  */
 void emitRM( char * op, int r, int d, int s, char *c)
-{ fprintf(code,"%3d:  %5s  %d,%d(%d) ",emitLoc++,op,r,d,s);
-  if (TraceCode) fprintf(code,"\t%s",c) ;
-  fprintf(code,"\n") ;
-  if (highEmitLoc < emitLoc)  highEmitLoc = emitLoc ;
+{ emitInstr(FALSE,op,r,d,s,c);
 } /* emitRM */
 
 /* Function emitSkip skips "howMany" code
@@ -64,7 +168,7 @@ int emitSkip( int howMany)
    return i;
 } /* emitSkip */
 
-/* Procedure emitBackup backs up to 
+/* Procedure emitBackup backs up to
  * loc = a previously skipped location
  */
 void emitBackup( int loc)
@@ -72,14 +176,14 @@ void emitBackup( int loc)
   emitLoc = loc ;
 } /* emitBackup */
 
-/* Procedure emitRestore restores the current 
+/* Procedure emitRestore restores the current
  * code position to the highest previously
  * unemitted position
  */
 void emitRestore(void)
 { emitLoc = highEmitLoc;}
 
-/* Procedure emitRM_Abs converts an absolute reference 
+/* Procedure emitRM_Abs converts an absolute reference
  * to a pc-relative reference when emitting a
  * register-to-memory TM instruction
  * op = the opcode
@@ -88,11 +192,270 @@ void emitRestore(void)
  * c = a comment to be printed if TraceCode is TRUE
  */
 void emitRM_Abs( char *op, int r, int a, char * c)
-{ fprintf(code,"%3d:  %5s  %d,%d(%d) ",
-               emitLoc,op,r,a-(emitLoc+1),pc);
-  ++emitLoc ;
-  if (TraceCode) fprintf(code,"\t%s",c) ;
-  fprintf(code,"\n") ;
-  if (highEmitLoc < emitLoc) highEmitLoc = emitLoc ;
+{ emitInstr(FALSE,op,r,a-(emitLoc+1),pc,c);
 } /* emitRM_Abs */
 
+/* Procedure emitRM_Loc emits a register-to-memory
+ * TM instruction whose displacement is the
+ * absolute code location a (with base 0), such
+ * as a function or return address, so that it
+ * is relocated if code is moved
+ */
+void emitRM_Loc( char *op, int r, int a, char * c)
+{ emitInstr(FALSE,op,r,a,0,c);
+  codeBuf[emitLoc-1].isLoc = TRUE;
+} /* emitRM_Loc */
+
+/* Procedure emitReloc marks the instruction just
+ * emitted for relocation of kind by the linker;
+ * sym is the unit symbol (see unitSymbol) and d
+ * holds its location in the unit
+ */
+void emitReloc( int sym, int kind )
+{ codeBuf[emitLoc-1].reloc = sym;
+  codeBuf[emitLoc-1].relocKind = kind;
+} /* emitReloc */
+
+/* Procedure emitCode emits a copy of instruction
+ * in, read back from a unit, at the current
+ * location
+ */
+void emitCode( TMInstr * in )
+{ TMInstr * out = codeSlot(emitLoc);
+  *out = *in;
+  out->comment = -1;
+  out->line = curLine;
+  out->func = curFunc;
+  out->reloc = -1;
+  ++emitLoc;
+  if (highEmitLoc < emitLoc) highEmitLoc = emitLoc ;
+} /* emitCode */
+
+/* Function emitFuncName returns the name of the
+ * function of instruction in, or NULL
+ */
+char * emitFuncName( TMInstr * in )
+{ return (in->func >= 0) ? textPool+in->func : NULL;
+} /* emitFuncName */
+
+/* Function emitLine sets the source line recorded
+ * for the following instructions and returns the
+ * previous one
+ */
+int emitLine( int lineno )
+{ int old = curLine;
+  curLine = lineno;
+  return old;
+} /* emitLine */
+
+/* Procedure newFunc starts function name
+ * for the following instructions
+ */
+static void newFunc( char * name, int builtin )
+{ curFunc = (name != NULL) ? saveText(name) : -1;
+  if (name == NULL) return;
+  if (numFuncs == funcCap)
+  { funcCap = funcCap ? 2*funcCap : 64;
+    funcs = realloc(funcs,funcCap*sizeof(FuncRec));
+  }
+  funcs[numFuncs].text = curFunc;
+  funcs[numFuncs].builtin = builtin;
+  numFuncs++;
+} /* newFunc */
+
+/* Procedure emitFunc sets the function recorded for
+ * the following instructions (NULL: none)
+ */
+void emitFunc( char * name )
+{ newFunc(name,FALSE);
+} /* emitFunc */
+
+/* Procedure emitBuiltin is emitFunc for a
+ * built-in function
+ */
+void emitBuiltin( char * name )
+{ newFunc(name,TRUE);
+} /* emitBuiltin */
+
+/* Function emitBuffer returns the instruction
+ * buffer and sets *size to its number of locations
+ */
+TMInstr * emitBuffer( int * size )
+{ codeSlot(highEmitLoc);
+  *size = highEmitLoc;
+  return codeBuf;
+} /* emitBuffer */
+
+/* Procedure emitRelocate removes the buffer
+ * slots whose op is -1 and fixes up pc-relative
+ * displacements, code locations and comments
+ */
+void emitRelocate(void)
+{ int * newLoc = malloc((highEmitLoc+1)*sizeof(int));
+  int loc, t, n = 0;
+  TMInstr * in;
+  codeSlot(highEmitLoc);
+  for (loc = 0; loc < highEmitLoc; loc++)
+  { newLoc[loc] = n;
+    if (codeBuf[loc].op >= 0) n++;
+  }
+  newLoc[highEmitLoc] = n;
+  for (loc = 0; loc < highEmitLoc; loc++)
+  { in = &codeBuf[loc];
+    if (in->op < 0) continue;
+    if (in->isLoc)
+    { if ((in->arg2 >= 0) && (in->arg2 <= highEmitLoc))
+        in->arg2 = newLoc[in->arg2];
+    }
+    else if ((in->op >= tmLDA) && (in->op != tmLDC) && (in->arg3 == pc))
+    { t = loc+1+in->arg2;
+      if ((t >= 0) && (t <= highEmitLoc))
+        in->arg2 = newLoc[t]-(newLoc[loc]+1);
+    }
+    codeBuf[newLoc[loc]] = *in;
+  }
+  for (loc = n; loc < highEmitLoc; loc++) codeBuf[loc].op = -1;
+  for (t = 0; t < numComments; t++)
+    comments[t].loc = newLoc[comments[t].loc];
+  highEmitLoc = emitLoc = n;
+  free(newLoc);
+} /* emitRelocate */
+
+/* output text buffer for emitFlush */
+static char * outBuf = NULL;
+static int outLen = 0;
+static int outCap = 0;
+
+static void outPrintf( char * fmt, ... )
+{ va_list ap;
+  int n;
+  for (;;)
+  { va_start(ap,fmt);
+    n = vsnprintf(outBuf+outLen,outCap-outLen,fmt,ap);
+    va_end(ap);
+    if (n >= 0 && outLen+n < outCap) break;
+    outCap = outCap ? 2*outCap : 65536;
+    while (outLen+n >= outCap) outCap *= 2;
+    outBuf = realloc(outBuf,outCap);
+  }
+  outLen += n;
+} /* outPrintf */
+
+/* comment lines before location loc */
+static void flushComments( int * next, int loc )
+{ while ((*next < numComments) && (comments[*next].loc <= loc))
+    outPrintf("* %s\n",textPool+comments[(*next)++].text);
+} /* flushComments */
+
+/* Procedure flushLines writes the line table: a
+ * "loc line function" entry wherever the source
+ * line or function changes, up to the next entry
+ */
+static void flushLines(void)
+{ int loc, line = -1, func = -2;
+  TMInstr * in;
+  outPrintf("* C-Minus line table: loc line function\n");
+  for (loc = 0; loc < highEmitLoc; loc++)
+  { if (loc >= codeCap || codeBuf[loc].op < 0) continue;
+    in = &codeBuf[loc];
+    if ((in->line == line) && (in->func == func)) continue;
+    line = in->line;
+    func = in->func;
+    outPrintf("%d %d %s\n",loc,line,(func >= 0) ? textPool+func : "-");
+  }
+  fwrite(outBuf,1,outLen,codeLines);
+  outLen = 0;
+} /* flushLines */
+
+/* Procedure emitFlush writes the buffered code
+ * in location order to the code file with one
+ * write, to the object file (codeObj) and its
+ * line table to codeLines
+ */
+void emitFlush(void)
+{ int loc, next = 0;
+  TMInstr * in;
+  for (loc = 0; loc < highEmitLoc; loc++)
+  { flushComments(&next,loc);
+    if (loc >= codeCap || codeBuf[loc].op < 0) continue;
+    in = &codeBuf[loc];
+    if (! TraceCode) /* lean: no padding, no comment */
+      outPrintf(in->isRO ? "%d:%s %d,%d,%d\n" : "%d:%s %d,%d(%d)\n",
+                loc,opCodes[in->op],in->arg1,in->arg2,in->arg3);
+    else
+    { if (in->isRO)
+        outPrintf("%3d:  %5s  %d,%d,%d ",loc,opCodes[in->op],
+                  in->arg1,in->arg2,in->arg3);
+      else
+        outPrintf("%3d:  %5s  %d,%d(%d) ",loc,opCodes[in->op],
+                  in->arg1,in->arg2,in->arg3);
+      if (in->comment >= 0) outPrintf("\t%s",textPool+in->comment);
+      outPrintf("\n");
+    }
+  }
+  flushComments(&next,highEmitLoc);
+  fwrite(outBuf,1,outLen,code);
+  outLen = 0;
+
+  if (codeObj != NULL)
+  { TMOBJHEADER h;
+    TMOBJRECORD rec;
+    memcpy(h.magic,TMOBJ_MAGIC,4);
+    h.version = TMOBJ_VERSION;
+    h.count = highEmitLoc;
+    h.recordSize = sizeof(TMOBJRECORD);
+    fwrite(&h,sizeof(h),1,codeObj);
+    for (loc = 0; loc < highEmitLoc; loc++)
+    { if (loc >= codeCap || codeBuf[loc].op < 0)
+      { /* never backpatched: HALT */
+        rec.op = rec.arg1 = rec.arg2 = rec.arg3 = 0;
+      }
+      else
+      { rec.op = codeBuf[loc].op;
+        rec.arg1 = codeBuf[loc].arg1;
+        rec.arg2 = codeBuf[loc].arg2;
+        rec.arg3 = codeBuf[loc].arg3;
+      }
+      fwrite(&rec,sizeof(rec),1,codeObj);
+    }
+  }
+  if (codeLines != NULL) flushLines();
+} /* emitFlush */
+
+/* Function funcIndex returns the index in funcs
+ * of the function with textPool offset text,
+ * or -1 for none
+ */
+static int funcIndex( int text )
+{ int lo = 0, hi = numFuncs-1, mid;
+  while (lo <= hi)
+  { mid = (lo+hi)/2;
+    if (funcs[mid].text == text) return mid;
+    if (funcs[mid].text < text) lo = mid+1;
+    else hi = mid-1;
+  }
+  return -1;
+} /* funcIndex */
+
+/* Procedure emitSizeReport prints to f the number
+ * of instructions in the prelude (with the final
+ * HALT), in each built-in and in each function
+ */
+void emitSizeReport( FILE * f )
+{ int * count = calloc(numFuncs+1,sizeof(int));
+  int loc, i, total = 0;
+  for (loc = 0; loc < highEmitLoc; loc++)
+  { if (loc >= codeCap || codeBuf[loc].op < 0) continue;
+    count[funcIndex(codeBuf[loc].func)+1]++;
+    total++;
+  }
+  fprintf(f,"\nCode size: %d instructions\n",total);
+  fprintf(f,"  %-20s %8d\n","prelude",count[0]);
+  for (i = 0; i < numFuncs; i++)
+    if (funcs[i].builtin)
+      fprintf(f,"  %-20s %8d  built-in\n",textPool+funcs[i].text,count[i+1]);
+  for (i = 0; i < numFuncs; i++)
+    if (! funcs[i].builtin)
+      fprintf(f,"  %-20s %8d\n",textPool+funcs[i].text,count[i+1]);
+  free(count);
+} /* emitSizeReport */
@@ -36,6 +36,42 @@
 /* 2nd accumulator */
 #define ac1 1
 
+/* 3rd accumulator, for expression temporaries */
+#define ac2 3
+
+/* opcode numbers of TMInstr.op, in the
+ * order of TMOBJ_OPCODES (tmobj.h)
+ */
+typedef enum
+   { tmHALT, tmIN, tmOUT, tmADD, tmSUB, tmMUL, tmDIV, tmRRLim,
+     tmLD, tmST, tmRMLim,
+     tmLDA, tmLDC, tmJLT, tmJLE, tmJGT, tmJGE, tmJEQ, tmJNE
+   } TMOpCode;
+
+/* kinds of unit relocation (see emitReloc):
+ * RelocData adds the linked location of a global
+ * to d, RelocFrame the frame size of a function
+ */
+typedef enum { RelocData, RelocFrame } RelocKind;
+
+/* TMInstr is one buffered TM instruction;
+ * the emitters fill a buffer indexed by
+ * location that emitFlush writes out
+ */
+typedef struct
+   { int op;     /* opcode number (tmobj.h), -1 if empty */
+     int isRO;   /* printed as r,s,t rather than r,d(s) */
+     int arg1;   /* r */
+     int arg2;   /* s, or d */
+     int arg3;   /* t, or s */
+     int comment; /* offset of the comment text, or -1 */
+     int isLoc;  /* d is an absolute code location */
+     int line;   /* source line that produced it */
+     int func;   /* offset of its function's name, or -1 */
+     int reloc;  /* unit symbol of its relocation, or -1 */
+     int relocKind; /* RelocData or RelocFrame */
+   } TMInstr;
+
 /* code emitting utilities */
 
 /* Procedure emitComment prints a comment line 
@@ -90,4 +126,70 @@ void emitRestore(void);
  */
 void emitRM_Abs( char *op, int r, int a, char * c);
 
+/* Procedure emitRM_Loc emits a register-to-memory
+ * TM instruction whose displacement is the
+ * absolute code location a (with base 0), such
+ * as a function or return address, so that it
+ * is relocated if code is moved
+ */
+void emitRM_Loc( char *op, int r, int a, char * c);
+
+/* Procedure emitReloc marks the instruction just
+ * emitted for relocation of kind by the linker;
+ * sym is the unit symbol (see unitSymbol) and d
+ * holds its location in the unit
+ */
+void emitReloc( int sym, int kind );
+
+/* Procedure emitCode emits a copy of instruction
+ * in, read back from a unit, at the current
+ * location
+ */
+void emitCode( TMInstr * in );
+
+/* Function emitFuncName returns the name of the
+ * function of instruction in, or NULL
+ */
+char * emitFuncName( TMInstr * in );
+
+/* Function emitLine sets the source line recorded
+ * for the following instructions and returns the
+ * previous one
+ */
+int emitLine( int lineno );
+
+/* Procedure emitFunc sets the function recorded for
+ * the following instructions (NULL: none)
+ */
+void emitFunc( char * name );
+
+/* Procedure emitBuiltin is emitFunc for a
+ * built-in function
+ */
+void emitBuiltin( char * name );
+
+/* Function emitBuffer returns the instruction
+ * buffer and sets *size to its number of locations
+ */
+TMInstr * emitBuffer( int * size );
+
+/* Procedure emitRelocate removes the buffer
+ * slots whose op is -1 and fixes up pc-relative
+ * displacements, code locations and comments
+ */
+void emitRelocate(void);
+
+/* Procedure emitFlush writes the buffered code
+ * in location order to the code file with one
+ * write, to the object file (codeObj) and its
+ * line table to codeLines
+ */
+void emitFlush(void);
+
+/* Procedure emitSizeReport prints to f the number
+ * of instructions in the prelude, in each built-in
+ * and in each function
+ */
+void emitSizeReport( FILE * f );
+
 #endif
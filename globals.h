@@ -55,6 +55,8 @@ typedef int TokenType;
 extern FILE* source; /* source code text file */
 extern FILE* listing; /* listing output text file */
 extern FILE* code; /* code text file for TM simulator */
+extern FILE* codeObj; /* binary TM object file (tmobj.h), or NULL */
+extern FILE* codeLines; /* line table (.tml), or NULL */
 
 extern int lineno; /* source line number for listing */
 
@@ -81,7 +83,6 @@ typedef enum {Void,Integer,IntegerArray, Err} ExpType;
 
 #define MAXCHILDREN 3
 
-struct ScopeRec;
 
 typedef struct treeNode
    { struct treeNode * child[MAXCHILDREN];
@@ -98,7 +99,9 @@ typedef struct treeNode
              int val;
              char * name;
              ArrayAttr arr; } attr;
-     struct ScopeListRec * scope;
+     struct ScopeListRec * scope; /* CompK: its scope; IdK, ArrIdK,
+                                     CallK: the declaring scope */
+     struct BucketListRec * sym; /* IdK, ArrIdK, CallK: the symbol */
      ExpType type; /* for type checking of exps */
    } TreeNode;
 
@@ -130,10 +133,42 @@ extern int TraceParse;
 extern int TraceAnalyze;
 
 /* TraceCode = TRUE causes comments to be written
- * to the TM code file as code is generated
+ * to the TM code file as code is generated;
+ * FALSE writes bare instructions
  */
 extern int TraceCode;
 
+/* SizeReport = TRUE prints the code size of the
+ * prelude, the built-ins and each function
+ */
+extern int SizeReport;
+
+/**************************************************/
+/***********   Flags for optimization  ************/
+/**************************************************/
+
+/* Optimize = TRUE folds constants in the syntax
+ * tree between type checking and code generation
+ */
+extern int Optimize;
+
+/* Peephole = TRUE runs the peephole optimizer
+ * over the TM code before it is written
+ */
+extern int Peephole;
+
+/* FusedAnalysis = TRUE builds the symbol table
+ * and checks types in one syntax tree traversal
+ * (option --fused)
+ */
+extern int FusedAnalysis;
+
+/* CompileOnly = TRUE compiles the source to a
+ * unit object (.tmu) for the linker rather than
+ * to a program (option -c)
+ */
+extern int CompileOnly;
+
 /* Error = TRUE prevents further passes if an error occurs */
 extern int Error;
 #endif
@@ -0,0 +1,474 @@
+/****************************************************/
+/* File: link.c                                     */
+/* Unit objects and the TM linker for the C-Minus   */
+/* compiler                                         */
+/****************************************************/
+
+#include "globals.h"
+#include "symtab.h"
+#include "code.h"
+#include "cgen.h"
+#include "tmobj.h"
+#include "link.h"
+
+/**********************************************/
+/* writing the unit being compiled            */
+/**********************************************/
+
+/* the globals the unit refers to or defines,
+   in order of first use */
+typedef struct
+   { BucketList sym;
+     int defined; /* a function of the unit */
+   } UnitSymRec;
+
+static UnitSymRec * unitSyms = NULL;
+static int numUnitSyms = 0;
+static int unitSymCap = 0;
+
+/* open addressing table on the symbol pointer,
+   holding unitSyms index+1 (0: empty) */
+static int * unitIndex = NULL;
+static int unitIndexSize = 0;
+
+#define PTR_HASH(p) ((unsigned) (((unsigned long) (p)) >> 4))
+
+/* Procedure growUnitIndex doubles unitIndex
+ * and enters every unit symbol again
+ */
+static void growUnitIndex(void)
+{ int i;
+  unsigned h;
+  free(unitIndex);
+  unitIndexSize = unitIndexSize ? 2*unitIndexSize : 256;
+  unitIndex = calloc(unitIndexSize,sizeof(int));
+  for (i = 0; i < numUnitSyms; i++)
+  { h = PTR_HASH(unitSyms[i].sym) & (unitIndexSize-1);
+    while (unitIndex[h] != 0) h = (h+1) & (unitIndexSize-1);
+    unitIndex[h] = i+1;
+  }
+} /* growUnitIndex */
+
+/* Function unitSymbol returns the number of
+ * global l in the unit being compiled
+ */
+int unitSymbol( BucketList l )
+{ unsigned h;
+  if (2*(numUnitSyms+1) > unitIndexSize) growUnitIndex();
+  h = PTR_HASH(l) & (unitIndexSize-1);
+  while (unitIndex[h] != 0)
+  { if (unitSyms[unitIndex[h]-1].sym == l) return unitIndex[h]-1;
+    h = (h+1) & (unitIndexSize-1);
+  }
+  if (numUnitSyms == unitSymCap)
+  { unitSymCap = unitSymCap ? 2*unitSymCap : 64;
+    unitSyms = realloc(unitSyms,unitSymCap*sizeof(UnitSymRec));
+  }
+  unitSyms[numUnitSyms].sym = l;
+  unitSyms[numUnitSyms].defined = FALSE;
+  unitIndex[h] = ++numUnitSyms;
+  return numUnitSyms-1;
+} /* unitSymbol */
+
+/* Procedure unitDefine records that the unit
+ * being compiled defines function l
+ */
+void unitDefine( BucketList l )
+{ int i = unitSymbol(l);
+  unitSyms[i].defined = TRUE;
+} /* unitDefine */
+
+/* Procedure writeUnit writes the buffered code
+ * of the unit to f, the unit object unitfile
+ */
+void writeUnit( FILE * f, char * unitfile )
+{ int size, loc, n = 0;
+  int text = -1, sym = -1;
+  int * func;
+  char * name, tag;
+  TMInstr * buf = emitBuffer(&size);
+  TMInstr * in;
+  UnitSymRec * u;
+  BucketList l;
+  char * opCodes[] = TMOBJ_OPCODES;
+  /* the function symbols go first, so that the
+     symbol count is known before the code */
+  func = malloc((size+1)*sizeof(int));
+  for (loc = 0; loc < size; loc++)
+  { in = &buf[loc];
+    if (in->op < 0) continue;
+    n++;
+    if (in->func != text)
+    { text = in->func;
+      name = emitFuncName(in);
+      l = (name != NULL) ? st_lookup_function(st_intern(name)) : NULL;
+      sym = (l != NULL) ? unitSymbol(l) : -1;
+    }
+    func[loc] = sym;
+  }
+  fprintf(f,"* C-Minus unit: %s\n",unitfile);
+  fprintf(f,"unit %d %d %d\n",UNIT_VERSION,numUnitSyms,n);
+  for (u = unitSyms; u < unitSyms+numUnitSyms; u++)
+  { l = u->sym;
+    if (l->i_type == Func)
+      fprintf(f,"%s %c %d 0 %d %d\n",l->name,u->defined ? 'F' : 'f',
+              l->memloc,(u->defined && l->scope) ? l->scope->mem_size : 0,
+              l->scope ? l->scope->max_param_num : 0);
+    else if (l->type == IntegerArray)
+      fprintf(f,"%s A %d %d 0 0\n",l->name,l->memloc,l->size);
+    else
+      fprintf(f,"%s V %d 0 0 0\n",l->name,l->memloc);
+  }
+  for (loc = 0; loc < size; loc++)
+  { in = &buf[loc];
+    if (in->op < 0) continue;
+    if (in->isRO) tag = 'r';
+    else if (in->isLoc) tag = 'l';
+    else if (in->reloc >= 0) tag = (in->relocKind == RelocData) ? 'd' : 'f';
+    else tag = 'm';
+    fprintf(f,"%s %d %d %d %c %d %d %d\n",opCodes[in->op],
+            in->arg1,in->arg2,in->arg3,tag,in->reloc,in->line,func[loc]);
+  }
+  free(func);
+} /* writeUnit */
+
+/**********************************************/
+/* loading and linking units                  */
+/**********************************************/
+
+/* a global of the linked program; kind is
+   as in a unit, 0 while unknown, and F once
+   some unit defines the function */
+typedef struct
+   { char * name; /* interned */
+     int kind;
+     int size;
+     int frame, params;
+     int memloc; /* linked location */
+     char * unit; /* file that defines or first uses it */
+   } LinkSymRec;
+
+static LinkSymRec * linkSyms = NULL;
+static int numLinkSyms = 0;
+static int linkSymCap = 0;
+
+/* open addressing table on the name pointer,
+   holding linkSyms index+1 (0: empty) */
+static int * linkIndex = NULL;
+static int linkIndexSize = 0;
+
+/* a loaded unit: its symbols as linkSyms
+   indices with the unit's memlocs, and its
+   code, where reloc and func are unit
+   symbols */
+typedef struct
+   { char * file;
+     int numSyms;
+     int * syms;
+     int * memloc;
+     TMInstr * code;
+     int numCode;
+   } UnitRec;
+
+static UnitRec * units = NULL;
+static int numUnits = 0;
+
+/* the unit that defines main, or -1 */
+static int mainUnit = -1;
+
+/* Procedure growLinkIndex doubles linkIndex
+ * and enters every symbol again
+ */
+static void growLinkIndex(void)
+{ int i;
+  unsigned h;
+  free(linkIndex);
+  linkIndexSize = linkIndexSize ? 2*linkIndexSize : 256;
+  linkIndex = calloc(linkIndexSize,sizeof(int));
+  for (i = 0; i < numLinkSyms; i++)
+  { h = PTR_HASH(linkSyms[i].name) & (linkIndexSize-1);
+    while (linkIndex[h] != 0) h = (h+1) & (linkIndexSize-1);
+    linkIndex[h] = i+1;
+  }
+} /* growLinkIndex */
+
+/* Function linkSymbol returns the number of
+ * the global named name, adding it if new
+ */
+static int linkSymbol( char * name )
+{ unsigned h;
+  LinkSymRec * g;
+  if (2*(numLinkSyms+1) > linkIndexSize) growLinkIndex();
+  h = PTR_HASH(name) & (linkIndexSize-1);
+  while (linkIndex[h] != 0)
+  { if (linkSyms[linkIndex[h]-1].name == name) return linkIndex[h]-1;
+    h = (h+1) & (linkIndexSize-1);
+  }
+  if (numLinkSyms == linkSymCap)
+  { linkSymCap = linkSymCap ? 2*linkSymCap : 256;
+    linkSyms = realloc(linkSyms,linkSymCap*sizeof(LinkSymRec));
+  }
+  g = &linkSyms[numLinkSyms];
+  g->name = name;
+  g->kind = 0;
+  g->size = g->frame = g->params = g->memloc = 0;
+  g->unit = NULL;
+  linkIndex[h] = ++numLinkSyms;
+  return numLinkSyms-1;
+} /* linkSymbol */
+
+/* Procedure linkError prints error message
+ * fmt with up to three strings to the listing
+ */
+static void linkError( char * fmt, char * name, char * a, char * b )
+{ fprintf(listing,"error: ");
+  fprintf(listing,fmt,name,a,b);
+  fprintf(listing,"\n");
+  Error = TRUE;
+}
+
+/* Procedure builtin enters built-in function
+ * name with the location sc_init gave it
+ */
+static void builtin( char * name )
+{ BucketList l = st_lookup_function(st_intern(name));
+  int i = linkSymbol(l->name);
+  LinkSymRec * g = &linkSyms[i];
+  g->kind = 'F';
+  g->frame = l->scope->mem_size;
+  g->params = l->scope->max_param_num;
+  g->memloc = l->memloc;
+  g->unit = "built-in";
+} /* builtin */
+
+/* Procedure resolve merges symbol name of kind
+ * from unit file into linkSyms and returns its
+ * number. Variables of the same name and size
+ * in several units are one variable
+ */
+static int resolve( char * file, char * name, int kind,
+                    int size, int frame, int params )
+{ int i = linkSymbol(st_intern(name));
+  LinkSymRec * g = &linkSyms[i];
+  int isFunc = (kind == 'F') || (kind == 'f');
+  if (g->kind == 0)
+  { g->kind = kind;
+    g->size = size;
+    g->frame = frame;
+    g->params = params;
+    g->unit = file;
+    return i;
+  }
+  if (isFunc != ((g->kind == 'F') || (g->kind == 'f')))
+    linkError("%s is a function and a variable (%s, %s)",name,g->unit,file);
+  else if (! isFunc)
+  { if ((g->kind != kind) || (g->size != size))
+      linkError("%s has different sizes in %s and %s",name,g->unit,file);
+  }
+  else if ((kind == 'F') && (g->kind == 'F'))
+    linkError("function %s is defined in %s and %s",name,g->unit,file);
+  else
+  { if (g->params != params)
+      linkError("function %s has different parameters in %s and %s",
+                name,g->unit,file);
+    if (kind == 'F')
+    { g->kind = 'F';
+      g->frame = frame;
+      g->params = params;
+      g->unit = file;
+    }
+  }
+  return i;
+} /* resolve */
+
+/* Function opNumber returns the opcode number
+ * of op, or -1
+ */
+static int opNumber( char * op )
+{ static char * opCodes[] = TMOBJ_OPCODES;
+  int i;
+  for (i = 0; i < TMOBJ_NUM_OPCODES; i++)
+    if (strcmp(opCodes[i],op) == 0) return i;
+  return -1;
+} /* opNumber */
+
+/* Function nextLine reads the next line of f
+ * that is no comment into line
+ */
+static int nextLine( FILE * f, char * line, int n )
+{ while (fgets(line,n,f) != NULL)
+    if (line[0] != '*') return TRUE;
+  return FALSE;
+} /* nextLine */
+
+/* Function parseInstr reads instruction line
+ * of a unit with numSyms symbols into in by
+ * hand, as scanf is slow for the code of a big
+ * unit; FALSE if malformed
+ */
+static int parseInstr( char * line, int numSyms, TMInstr * in )
+{ char * p = line, * end;
+  char tag = 0;
+  int v[6], i;
+  while (isalpha(*p)) p++;
+  if (*p != ' ') return FALSE;
+  *p++ = '\0';
+  if ((in->op = opNumber(line)) < 0) return FALSE;
+  for (i = 0; i < 6; i++)
+  { if (i == 3)
+    { while (*p == ' ') p++;
+      tag = *p++;
+      if ((tag == '\0') || (strchr("rmldf",tag) == NULL)) return FALSE;
+    }
+    v[i] = strtol(p,&end,10);
+    if (end == p) return FALSE;
+    p = end;
+  }
+  /* symbol numbers index the unit's tables */
+  if ((v[3] < -1) || (v[3] >= numSyms) || (v[5] < -1) || (v[5] >= numSyms))
+    return FALSE;
+  if (((tag == 'd') || (tag == 'f')) && (v[3] < 0)) return FALSE;
+  in->arg1 = v[0];
+  in->arg2 = v[1];
+  in->arg3 = v[2];
+  in->isRO = (tag == 'r');
+  in->isLoc = (tag == 'l');
+  in->reloc = ((tag == 'd') || (tag == 'f')) ? v[3] : -1;
+  in->relocKind = (tag == 'd') ? RelocData : RelocFrame;
+  in->comment = -1;
+  in->line = v[4];
+  in->func = v[5];
+  return TRUE;
+} /* parseInstr */
+
+/* Function loadUnit reads unit object file
+ * into u; FALSE if it is no unit
+ */
+static int loadUnit( char * file, UnitRec * u )
+{ char line[256], name[128];
+  char kind;
+  int version, memloc, size, frame, params, i;
+  TMInstr * in;
+  FILE * f = fopen(file,"r");
+  if (f == NULL)
+  { linkError("cannot open %s",file,NULL,NULL);
+    return FALSE;
+  }
+  u->file = file;
+  if (! nextLine(f,line,sizeof(line))
+      || (sscanf(line,"unit %d %d %d",&version,&u->numSyms,&u->numCode) != 3)
+      || (version != UNIT_VERSION) || (u->numSyms < 0) || (u->numCode < 0))
+  { fclose(f);
+    linkError("%s is not a C-Minus unit",file,NULL,NULL);
+    return FALSE;
+  }
+  u->syms = malloc(((size_t)u->numSyms+1)*sizeof(int));
+  u->memloc = malloc(((size_t)u->numSyms+1)*sizeof(int));
+  u->code = malloc(((size_t)u->numCode+1)*sizeof(TMInstr));
+  for (i = 0; i < u->numSyms; i++)
+  { if (! nextLine(f,line,sizeof(line))
+        || (sscanf(line,"%127s %c %d %d %d %d",name,&kind,
+                   &memloc,&size,&frame,&params) != 6))
+      break;
+    u->syms[i] = resolve(file,name,kind,size,frame,params);
+    u->memloc[i] = memloc;
+    if ((kind == 'F') && (strcmp(name,"main") == 0))
+      mainUnit = u-units;
+  }
+  for (in = u->code; (i == u->numSyms) && (in < u->code+u->numCode); in++)
+    if (! nextLine(f,line,sizeof(line)) || ! parseInstr(line,u->numSyms,in))
+      break;
+  fclose(f);
+  if ((i != u->numSyms) || (in != u->code+u->numCode))
+  { linkError("%s is truncated or corrupt",file,NULL,NULL);
+    return FALSE;
+  }
+  return TRUE;
+} /* loadUnit */
+
+/* Function loadUnits reads the n unit objects
+ * named by files and resolves their symbols;
+ * it reports undefined and multiply defined
+ * symbols to the listing and returns FALSE
+ * if there are any
+ */
+int loadUnits( int n, char ** files )
+{ int next;
+  LinkSymRec * g;
+  sc_init();
+  builtin("input");
+  builtin("output");
+  units = calloc(n,sizeof(UnitRec));
+  for (numUnits = 0; numUnits < n; numUnits++)
+    if (! loadUnit(files[numUnits],&units[numUnits])) return FALSE;
+  for (g = linkSyms; g < linkSyms+numLinkSyms; g++)
+    if (g->kind == 'f')
+      linkError("function %s is called in %s but not defined",
+                g->name,g->unit,NULL);
+  if (mainUnit < 0)
+    linkError("no unit defines main",NULL,NULL,NULL);
+  if (Error) return FALSE;
+  /* the globals of the units follow those
+     of the built-ins, laid out as st_insert
+     lays out one program */
+  next = sc_top()->mem_size;
+  for (g = linkSyms; g < linkSyms+numLinkSyms; g++)
+  { if (g->memloc != 0) continue;
+    if (g->kind == 'A')
+    { g->memloc = next+g->size;
+      next += g->size+1;
+    }
+    else g->memloc = next++;
+  }
+  return TRUE;
+} /* loadUnits */
+
+/* Procedure linkUnit emits the code of unit u,
+ * relocated to the current location
+ */
+static void linkUnit( UnitRec * u )
+{ int base = emitSkip(0);
+  int func = -2;
+  TMInstr * in;
+  LinkSymRec * g;
+  if (TraceCode)
+  { char * s = malloc(strlen(u->file)+7);
+    sprintf(s,"Unit: %s",u->file);
+    emitComment(s);
+    free(s);
+  }
+  for (in = u->code; in < u->code+u->numCode; in++)
+  { if (in->func != func)
+    { func = in->func;
+      emitFunc((func >= 0) ? linkSyms[u->syms[func]].name : NULL);
+    }
+    emitLine(in->line);
+    if (in->isLoc) in->arg2 += base;
+    if (in->reloc >= 0)
+    { g = &linkSyms[u->syms[in->reloc]];
+      if (in->relocKind == RelocData)
+        in->arg2 += g->memloc-u->memloc[in->reloc];
+      else
+        in->arg2 += g->frame;
+    }
+    emitCode(in);
+  }
+} /* linkUnit */
+
+/* Procedure linkUnits writes the program of
+ * the loaded units, with the standard prelude,
+ * the built-ins and the final HALT, to the
+ * code files (see emitFlush)
+ */
+void linkUnits( char * codefile )
+{ int i;
+  genPrelude(codefile);
+  /* every function pointer is set before main
+     runs, so the unit of main goes last */
+  for (i = 0; i < numUnits; i++)
+    if (i != mainUnit) linkUnit(&units[i]);
+  linkUnit(&units[mainUnit]);
+  genEnd();
+  emitFlush();
+  if (SizeReport) emitSizeReport(listing);
+} /* linkUnits */
@@ -0,0 +1,67 @@
+/****************************************************/
+/* File: link.h                                     */
+/* Unit objects and the TM linker for the C-Minus   */
+/* compiler                                         */
+/****************************************************/
+
+#ifndef _LINK_H_
+#define _LINK_H_
+
+#include "globals.h"
+#include "symtab.h"
+
+/* A unit object (.tmu) is the code of one
+ * source file compiled with -c: text lines
+ *
+ *   * comment
+ *   unit <version> <symbols> <instructions>
+ *   <name> <kind> <memloc> <size> <frame> <params>
+ *   <op> <r> <d> <s> <tag> <symbol> <line> <function>
+ *
+ * Symbol kinds are F (function defined in the
+ * unit), f (function called but only declared),
+ * V (variable) and A (array of size words).
+ * memloc is the location the unit gave a global,
+ * frame and params the frame size and parameter
+ * count of a function.
+ * Instruction tags are r (register only), m (no
+ * relocation), l (d is a code location of the
+ * unit), d (d holds the unit memloc of symbol)
+ * and f (d gets the frame size of symbol);
+ * function is the symbol of the instruction's
+ * function or -1. The unit has no prelude, no
+ * built-ins and no final HALT
+ */
+#define UNIT_VERSION 1
+
+/* Function unitSymbol returns the number of
+ * global l in the unit being compiled
+ */
+int unitSymbol( BucketList l );
+
+/* Procedure unitDefine records that the unit
+ * being compiled defines function l
+ */
+void unitDefine( BucketList l );
+
+/* Procedure writeUnit writes the buffered code
+ * of the unit to f, the unit object unitfile
+ */
+void writeUnit( FILE * f, char * unitfile );
+
+/* Function loadUnits reads the n unit objects
+ * named by files and resolves their symbols;
+ * it reports undefined and multiply defined
+ * symbols to the listing and returns FALSE
+ * if there are any
+ */
+int loadUnits( int n, char ** files );
+
+/* Procedure linkUnits writes the program of
+ * the loaded units, with the standard prelude,
+ * the built-ins and the final HALT, to the
+ * code files (see emitFlush)
+ */
+void linkUnits( char * codefile );
+
+#endif
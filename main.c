@@ -6,6 +6,9 @@
 /****************************************************/
 
 #include "globals.h"
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
 
 /* set NO_PARSE to TRUE to get a scanner-only compiler */
 #define NO_PARSE FALSE
@@ -24,8 +27,10 @@
 #include "parse.h"
 #if !NO_ANALYZE
 #include "analyze.h"
+#include "opt.h"
 #if !NO_CODE
 #include "cgen.h"
+#include "link.h"
 #endif
 #endif
 #endif
@@ -35,24 +40,506 @@ int lineno = 0;
 FILE * source;
 FILE * listing;
 FILE * code;
+FILE * codeObj;
+FILE * codeLines;
 
 /* allocate and set tracing flags */
-int EchoSource = TRUE;
+int EchoSource = FALSE;
 int TraceScan = FALSE;
 int TraceParse = FALSE;
 int TraceAnalyze = TRUE;
 int TraceCode = TRUE;
+int SizeReport = FALSE;
+
+/* allocate and set optimization flags */
+int Optimize = TRUE;
+int Peephole = TRUE;
+int FusedAnalysis = FALSE;
+
+int CompileOnly = FALSE;
 
 int Error = FALSE;
 
+/* the tracing flags by option name: --<name>
+ * sets a flag and --no-<name> clears it
+ */
+static struct { char * name; int * flag; } traceFlags[] =
+  { { "echo", &EchoSource },
+    { "trace-scan", &TraceScan },
+    { "trace-parse", &TraceParse },
+    { "trace-analyze", &TraceAnalyze },
+    { "trace-code", &TraceCode } };
+
+#define NUM_TRACE_FLAGS ((int) (sizeof(traceFlags)/sizeof(traceFlags[0])))
+
+/* Function traceOption sets or clears the flag
+ * named by option arg; FALSE if there is none
+ */
+static int traceOption( char * arg )
+{ int i, on = TRUE;
+  if (strncmp(arg,"--",2) != 0) return FALSE;
+  arg += 2;
+  if (strncmp(arg,"no-",3) == 0)
+  { arg += 3;
+    on = FALSE;
+  }
+  for (i = 0; i < NUM_TRACE_FLAGS; i++)
+    if (strcmp(arg,traceFlags[i].name) == 0)
+    { *traceFlags[i].flag = on;
+      return TRUE;
+    }
+  return FALSE;
+}
+
+/* Procedure quiet clears every tracing flag */
+static void quiet(void)
+{ int i;
+  for (i = 0; i < NUM_TRACE_FLAGS; i++) *traceFlags[i].flag = FALSE;
+}
+
+/* Function tracing tells whether any listing
+ * is wanted besides error messages
+ */
+static int tracing(void)
+{ int i;
+  for (i = 0; i < NUM_TRACE_FLAGS; i++)
+    if (*traceFlags[i].flag) return TRUE;
+  return FALSE;
+}
+
+/* Procedure echoSource prints the source
+ * with line numbers to the listing
+ */
+static void echoSource(void)
+{ char line[256];
+  int n = 0, bol = TRUE;
+  fprintf(listing,"\n");
+  while (fgets(line,sizeof(line),source) != NULL)
+  { if (bol) fprintf(listing,"%4d: ",++n);
+    bol = (strchr(line,'\n') != NULL);
+    fputs(line,listing);
+  }
+  if (! bol) fprintf(listing,"\n");
+  rewind(source);
+}
+
+/* the listing goes through this one buffer */
+static char listingBuf[65536];
+
+/* Function isUnit tells whether file is a
+ * unit object (.tmu) to link
+ */
+static int isUnit( char * file )
+{ int n = strlen(file);
+  return (n > 4) && (strcmp(file+n-4,".tmu") == 0);
+}
+
+/* Function codeName returns the name of file
+ * up to its first '.' with extension ext
+ */
+static char * codeName( char * file, char * ext )
+{ int fnlen = strcspn(file,".");
+  char * name = (char *) calloc(fnlen+strlen(ext)+1, sizeof(char));
+  strncpy(name,file,fnlen);
+  strcat(name,ext);
+  return name;
+}
+
+/* Function openCode opens file name for writing */
+static FILE * openCode( char * name, char * mode )
+{ FILE * f = fopen(name,mode);
+  if (f == NULL)
+  { printf("Unable to open %s\n",name);
+    exit(1);
+  }
+  return f;
+}
+
+/* Procedure openProgram opens the code files of
+ * program name: the code, the binary object
+ * next to it and the line table for tm --profile;
+ * it returns the code file name
+ */
+static char * openProgram( char * name )
+{ char * codefile = codeName(name,".tm");
+  code = openCode(codefile,"w");
+  codeObj = openCode(codeName(name,".tmo"),"wb");
+  codeLines = openCode(codeName(name,".tml"),"w");
+  return codefile;
+}
+
+/* Procedure closeProgram closes the code files */
+static void closeProgram(void)
+{ fclose(code);
+  if (codeObj != NULL) fclose(codeObj);
+  if (codeLines != NULL) fclose(codeLines);
+}
+
+/* the compile cache (--cache dir): an entry is
+ * the listing and the code files of one compile,
+ * or the listing and an .err mark for a compile
+ * with errors, named by a hash of the compiler,
+ * the options, the source file name and its
+ * text; the file stats counts the hits and the
+ * misses. Entry files are written under a name
+ * of the process and renamed into place, the
+ * listing last, so a lookup never sees a
+ * partial entry
+ */
+static char * cacheDir = NULL;
+static int cacheStats = FALSE;
+static char cacheKey[17];
+
+/* 64 bit FNV-1a */
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+static unsigned long long fnv( unsigned long long h, void * p, size_t n )
+{ unsigned char * b = p;
+  while (n-- > 0) h = (h ^ *b++) * FNV_PRIME;
+  return h;
+}
+
+/* Function hashFile adds the contents of file
+ * name to *h; FALSE if it cannot be read
+ */
+static int hashFile( unsigned long long * h, char * name )
+{ char buf[65536];
+  size_t n;
+  FILE * f = fopen(name,"rb");
+  if (f == NULL) return FALSE;
+  while ((n = fread(buf,1,sizeof(buf),f)) > 0) *h = fnv(*h,buf,n);
+  fclose(f);
+  return TRUE;
+}
+
+/* Function codeExts returns the extensions of
+ * the code files a compile writes
+ */
+static char ** codeExts(void)
+{ static char * program[] = { ".tm", ".tmo", ".tml", NULL };
+  static char * unit[] = { ".tmu", NULL };
+  return CompileOnly ? unit : program;
+}
+
+/* Function cachePath returns the name of the
+ * file of the current entry with extension ext
+ */
+static char * cachePath( char * ext )
+{ char * name = malloc(strlen(cacheDir)+strlen(cacheKey)+strlen(ext)+2);
+  sprintf(name,"%s/%s%s",cacheDir,cacheKey,ext);
+  return name;
+}
+
+/* Function copyStream copies the rest of in to
+ * out; FALSE if in or out fails
+ */
+static int copyStream( FILE * in, FILE * out )
+{ char buf[65536];
+  size_t n;
+  int ok = TRUE;
+  while ((n = fread(buf,1,sizeof(buf),in)) > 0)
+    if (fwrite(buf,1,n,out) != n) ok = FALSE;
+  return ok && ! ferror(in);
+}
+
+/* Function copyFile copies file from to file
+ * to; FALSE if from cannot be read or to
+ * cannot be written
+ */
+static int copyFile( char * from, char * to )
+{ int ok;
+  FILE * out, * in = fopen(from,"rb");
+  if (in == NULL) return FALSE;
+  if ((out = fopen(to,"wb")) == NULL)
+  { fclose(in);
+    return FALSE;
+  }
+  ok = copyStream(in,out);
+  fclose(in);
+  if (fclose(out) != 0) ok = FALSE;
+  return ok;
+}
+
+/* Function cacheTemp returns the name under
+ * which this process writes entry file path
+ */
+static char * cacheTemp( char * path )
+{ char * name = malloc(strlen(path)+24);
+  sprintf(name,"%s.%ld",path,(long) getpid());
+  return name;
+}
+
+/* Procedure cacheEnter renames temporary file
+ * tmp to entry file path, or removes it if it
+ * was not written completely (ok is FALSE)
+ */
+static void cacheEnter( char * tmp, char * path, int ok )
+{ if (! ok || (rename(tmp,path) != 0)) remove(tmp);
+  free(tmp);
+  free(path);
+}
+
+/* the stats file holds the hit and the miss
+ * count as two numbers of fixed width, so it
+ * is rewritten in place under a lock
+ */
+#define CACHE_HITS 0
+#define CACHE_MISSES 1
+#define COUNT_WIDTH 20
+
+/* Function openStats opens the stats file and
+ * locks it for reading or (write) updating;
+ * -1 if it cannot
+ */
+static int openStats( int write )
+{ char * path = malloc(strlen(cacheDir)+7);
+  struct flock lock;
+  int fd;
+  sprintf(path,"%s/stats",cacheDir);
+  fd = open(path,write ? (O_RDWR | O_CREAT) : O_RDONLY,0666);
+  free(path);
+  if (fd < 0) return -1;
+  memset(&lock,0,sizeof(lock));
+  lock.l_type = write ? F_WRLCK : F_RDLCK;
+  lock.l_whence = SEEK_SET;
+  if (fcntl(fd,F_SETLKW,&lock) != 0)
+  { close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/* Procedure readStats reads the counts of the
+ * stats file fd into count
+ */
+static void readStats( int fd, long count[2] )
+{ char buf[2*COUNT_WIDTH+3];
+  ssize_t n = pread(fd,buf,sizeof(buf)-1,0);
+  count[CACHE_HITS] = count[CACHE_MISSES] = 0;
+  if (n <= 0) return;
+  buf[n] = '\0';
+  sscanf(buf,"%ld %ld",&count[CACHE_HITS],&count[CACHE_MISSES]);
+}
+
+/* Procedure cacheCount adds a lookup to count
+ * i (CACHE_HITS or CACHE_MISSES)
+ */
+static void cacheCount( int i )
+{ char buf[2*COUNT_WIDTH+3];
+  long count[2];
+  int fd = openStats(TRUE);
+  if (fd < 0) return;
+  readStats(fd,count);
+  count[i]++;
+  sprintf(buf,"%*ld %*ld\n",COUNT_WIDTH,count[CACHE_HITS],
+          COUNT_WIDTH,count[CACHE_MISSES]);
+  if (pwrite(fd,buf,strlen(buf),0) < 0) ;
+  close(fd); /* and unlock */
+}
+
+/* Function cacheLookup sets the key of source
+ * file pgm compiled by cmd; on a hit it copies
+ * the entry's code files and listing out and
+ * returns TRUE. Without a key caching is off
+ */
+static int cacheLookup( char * pgm, char * cmd )
+{ unsigned long long h = FNV_OFFSET;
+  int flags[] = { EchoSource, TraceScan, TraceParse, TraceAnalyze,
+                  TraceCode, SizeReport, Optimize, Peephole,
+                  FusedAnalysis, CompileOnly };
+  char ** ext;
+  char * path, * to;
+  int ok, failed;
+  FILE * lst;
+  mkdir(cacheDir,0777); /* it may exist */
+  if (! hashFile(&h,"/proc/self/exe") && ! hashFile(&h,cmd))
+  { cacheDir = NULL;
+    return FALSE;
+  }
+  h = fnv(h,flags,sizeof(flags));
+  h = fnv(h,pgm,strlen(pgm)+1);
+  if (! hashFile(&h,pgm))
+  { cacheDir = NULL;
+    return FALSE;
+  }
+  sprintf(cacheKey,"%016llx",h);
+  /* the listing is renamed into place last, so
+   * an entry with a listing is complete */
+  path = cachePath(".lst");
+  lst = fopen(path,"rb");
+  free(path);
+  ok = (lst != NULL);
+  path = cachePath(".err");
+  failed = ok && (access(path,F_OK) == 0);
+  free(path);
+  /* an entry whose code cannot be copied out
+   * is a miss: the compile writes the code */
+  for (ext = codeExts(); ok && ! failed && (*ext != NULL); ext++)
+  { path = cachePath(*ext);
+    to = codeName(pgm,*ext);
+    ok = copyFile(path,to);
+    free(path);
+    free(to);
+  }
+  if (! ok)
+  { if (lst != NULL) fclose(lst);
+    cacheCount(CACHE_MISSES);
+    return FALSE;
+  }
+  copyStream(lst,listing);
+  fclose(lst);
+  Error = failed;
+  cacheCount(CACHE_HITS);
+  return TRUE;
+}
+
+/* Procedure cacheStore enters the code files of
+ * pgm, or the .err mark if there was an error,
+ * and the listing (a temporary file) into the
+ * cache, and copies the listing out
+ */
+static void cacheStore( char * pgm, FILE * tmp )
+{ char ** ext;
+  char * from, * path, * temp;
+  FILE * f;
+  char buf[65536];
+  size_t n;
+  int ok = TRUE;
+  for (ext = codeExts(); ok && ! Error && (*ext != NULL); ext++)
+  { from = codeName(pgm,*ext);
+    path = cachePath(*ext);
+    temp = cacheTemp(path);
+    ok = copyFile(from,temp);
+    cacheEnter(temp,path,ok);
+    free(from);
+  }
+  if (Error)
+  { path = cachePath(".err");
+    temp = cacheTemp(path);
+    f = fopen(temp,"wb");
+    ok = (f != NULL) && (fclose(f) == 0);
+    cacheEnter(temp,path,ok);
+  }
+  /* without all its files the entry would
+     be a hit that loses some */
+  path = ok ? cachePath(".lst") : NULL;
+  temp = (path != NULL) ? cacheTemp(path) : NULL;
+  f = (temp != NULL) ? fopen(temp,"wb") : NULL;
+  rewind(tmp);
+  while ((n = fread(buf,1,sizeof(buf),tmp)) > 0)
+  { fwrite(buf,1,n,stdout);
+    if (f != NULL) fwrite(buf,1,n,f);
+  }
+  fclose(tmp);
+  if (f != NULL)
+  { ok = ! ferror(f);
+    if (fclose(f) != 0) ok = FALSE;
+    cacheEnter(temp,path,ok);
+  }
+  else
+  { free(temp);
+    free(path);
+  }
+}
+
+/* Procedure cacheReport prints the cache hits
+ * and misses so far
+ */
+static void cacheReport(void)
+{ long count[2] = { 0, 0 };
+  int fd;
+  if (cacheDir == NULL) return;
+  fflush(stdout);
+  if ((fd = openStats(FALSE)) >= 0)
+  { readStats(fd,count);
+    close(fd);
+  }
+  fprintf(stderr,"cache: %ld hits, %ld misses\n",
+          count[CACHE_HITS],count[CACHE_MISSES]);
+}
+
+/* Procedure usage explains the options and exits */
+static void usage( char * cmd )
+{ fprintf(stderr,"usage: %s [options] <filename>\n",cmd);
+  fprintf(stderr,"       %s -c [options] <filename>\n",cmd);
+  fprintf(stderr,"       %s [-o <program>] <unit>.tmu ...\n",cmd);
+  fprintf(stderr,"   -c                 compile to the unit object <file>.tmu\n"
+                 "                      for linking\n");
+  fprintf(stderr,"   -o <program>       link the units to <program>.tm\n"
+                 "                      (default: the first unit's name)\n");
+  fprintf(stderr,"   --cache <dir>      reuse the listing and code of an\n"
+                 "                      unchanged compile from cache dir\n");
+  fprintf(stderr,"   --cache-stats      print the cache hits and misses\n");
+  fprintf(stderr,"   --fused            build the symbol table and check\n"
+                 "                      types in one tree traversal\n");
+  fprintf(stderr,"   --size             report the code size of the prelude,\n"
+                 "                      the built-ins and each function\n");
+  fprintf(stderr,"   --quiet            no listing, only error messages\n");
+  fprintf(stderr,"   --echo             echo the numbered source\n");
+  fprintf(stderr,"   --trace-scan       print each token\n");
+  fprintf(stderr,"   --trace-parse      print the syntax tree\n");
+  fprintf(stderr,"   --trace-analyze    print the symbol table (default)\n");
+  fprintf(stderr,"   --trace-code       comment the TM code (default)\n");
+  fprintf(stderr,"   --no-<flag>        turn a flag above off\n");
+  fprintf(stderr,"The exit status is 1 after a compile or link error\n");
+  exit(1);
+}
+
+/* Procedure linkProgram links the n unit
+ * objects files to program out
+ */
+static void linkProgram( int n, char ** files, char * out )
+{
+#if !NO_CODE
+  char * codefile;
+  if (tracing()) fprintf(listing,"\nTINY LINKING: %s\n",out);
+  if (loadUnits(n,files))
+  { codefile = openProgram(out);
+    linkUnits(codefile);
+    closeProgram();
+  }
+  arenaRelease();
+#endif
+}
+
 main( int argc, char * argv[] )
 { TreeNode * syntaxTree;
   char pgm[120]; /* source code file name */
-  if (argc != 2)
-    { fprintf(stderr,"usage: %s <filename>\n",argv[0]);
-      exit(1);
-    }
-  strcpy(pgm,argv[1]) ;
+  char ** files = malloc(argc*sizeof(char *));
+  char * file, * out = NULL;
+  int i, n = 0;
+  for (i = 1; i < argc; i++)
+  { if (strcmp(argv[i],"--fused") == 0) FusedAnalysis = TRUE;
+    else if (strcmp(argv[i],"--size") == 0) SizeReport = TRUE;
+    else if (strcmp(argv[i],"--quiet") == 0) quiet();
+    else if (strcmp(argv[i],"-c") == 0) CompileOnly = TRUE;
+    else if ((strcmp(argv[i],"-o") == 0) && (i+1 < argc)) out = argv[++i];
+    else if ((strcmp(argv[i],"--cache") == 0) && (i+1 < argc))
+      cacheDir = argv[++i];
+    else if (strcmp(argv[i],"--cache-stats") == 0) cacheStats = TRUE;
+    else if (traceOption(argv[i])) ;
+    else if (argv[i][0] == '-') usage(argv[0]);
+    else files[n++] = argv[i];
+  }
+  if ((n == 0) && cacheStats && (cacheDir != NULL))
+  { cacheReport();
+    return 0;
+  }
+  if (n == 0) usage(argv[0]);
+  listing = stdout; /* send listing to screen */
+  setvbuf(listing,listingBuf,_IOFBF,sizeof(listingBuf));
+  if (isUnit(files[0]))
+  { for (i = 0; i < n; i++)
+      if (! isUnit(files[i])) usage(argv[0]);
+    if (CompileOnly) usage(argv[0]);
+    linkProgram(n,files,(out != NULL) ? out : files[0]);
+    return Error ? 1 : 0;
+  }
+  file = files[0];
+  if ((n > 1) || (out != NULL) || (strlen(file) >= sizeof(pgm)-4))
+    usage(argv[0]);
+  strcpy(pgm,file) ;
   if (strchr (pgm, '.') == NULL)
      strcat(pgm,".tny");
   source = fopen(pgm,"r");
@@ -60,8 +547,20 @@ main( int argc, char * argv[] )
   { fprintf(stderr,"File %s not found\n",pgm);
     exit(1);
   }
-  listing = stdout; /* send listing to screen */
-  fprintf(listing,"\nTINY COMPILATION: %s\n",pgm);
+  if (cacheDir != NULL)
+  { if (cacheLookup(pgm,argv[0]))
+    { fclose(source);
+      if (cacheStats) cacheReport();
+      return Error ? 1 : 0;
+    }
+    /* on a miss the listing is kept for the cache */
+    if ((cacheDir != NULL) && ((listing = tmpfile()) == NULL))
+    { listing = stdout;
+      cacheDir = NULL;
+    }
+  }
+  if (tracing()) fprintf(listing,"\nTINY COMPILATION: %s\n",pgm);
+  if (EchoSource) echoSource();
 #if NO_PARSE
   while (getToken()!=ENDFILE);
 #else
@@ -69,34 +568,56 @@ main( int argc, char * argv[] )
   if (TraceParse) {
     fprintf(listing,"\nSyntax tree:\n");
     printTree(syntaxTree);
+    arenaStats();
   }
 #if !NO_ANALYZE
-  if (! Error)
+  if (! Error && FusedAnalysis)
+  { if (TraceAnalyze)
+      fprintf(listing,"\nBuilding Symbol Table and Checking Types...\n");
+    analyze(syntaxTree);
+    if (TraceAnalyze) fprintf(listing,"\nType Checking Finished\n");
+  }
+  else if (! Error)
   { if (TraceAnalyze) fprintf(listing,"\nBuilding Symbol Table...\n");
     buildSymtab(syntaxTree);
     if (TraceAnalyze) fprintf(listing,"\nChecking Types...\n");
     typeCheck(syntaxTree);
     if (TraceAnalyze) fprintf(listing,"\nType Checking Finished\n");
   }
+  if (! Error && Optimize)
+  { if (TraceAnalyze) fprintf(listing,"\nOptimizing Syntax Tree...\n");
+    optimize(syntaxTree);
+  }
 #if !NO_CODE
-  if (! Error)
-  { char * codefile;
-    int fnlen = strcspn(pgm,".");
-    codefile = (char *) calloc(fnlen+4, sizeof(char));
-    strncpy(codefile,pgm,fnlen);
-    strcat(codefile,".tm");
-    code = fopen(codefile,"w");
-    if (code == NULL)
-    { printf("Unable to open %s\n",codefile);
-      exit(1);
+  /* a whole program must define what it calls,
+   * a unit leaves that to the linker */
+  if (! Error && ! CompileOnly)
+  { BucketList l = st_undefined_function();
+    if (l != NULL)
+    { fprintf(listing,"error: function %s is called but not defined\n",
+              l->name);
+      Error = TRUE;
     }
+  }
+  if (! Error && CompileOnly)
+  { char * unitfile = codeName(pgm,".tmu");
+    code = openCode(unitfile,"w");
+    codeObj = codeLines = NULL;
+    codeGen(syntaxTree,unitfile);
+    closeProgram();
+  }
+  else if (! Error)
+  { char * codefile = openProgram(pgm);
     codeGen(syntaxTree,codefile);
-    fclose(code);
+    closeProgram();
   }
 #endif
 #endif
+  /* the syntax tree and its names go at once */
+  arenaRelease();
 #endif
   fclose(source);
-  return 0;
+  if (cacheDir != NULL) cacheStore(pgm,listing);
+  if (cacheStats) cacheReport();
+  return Error ? 1 : 0;
 }
-
@@ -0,0 +1,213 @@
+/****************************************************/
+/* File: opt.c                                      */
+/* Syntax tree optimizer implementation for the     */
+/* C-Minus compiler, run between typeCheck and      */
+/* codeGen                                          */
+/****************************************************/
+
+#include <limits.h>
+#include "globals.h"
+#include "opt.h"
+
+/* counters for the listing */
+static int numFolded = 0;
+static int numSimplified = 0;
+static int numBranches = 0;
+
+static int isConst( TreeNode * t )
+{ return (t != NULL) && (t->nodekind == ExpK) && (t->kind.exp == ConstK);
+}
+
+static int isConstVal( TreeNode * t, int val )
+{ return isConst(t) && (t->attr.val == val);
+}
+
+/* Function hasEffect tells whether evaluating
+ * expression t may call or assign
+ */
+static int hasEffect( TreeNode * t )
+{ if (t == NULL) return FALSE;
+  switch (t->kind.exp)
+  { case CallK:
+    case AssignK:
+      return TRUE;
+    default:
+      return hasEffect(t->child[0]) || hasEffect(t->child[1]);
+  }
+}
+
+/* Function evalOp sets *val to a op b as TM
+ * computes it; it returns FALSE if that would
+ * fault (division by 0), so the fault is kept
+ */
+static int evalOp( TokenType op, int a, int b, int * val )
+{ switch (op)
+  { case PLUS:  *val = (int) ((unsigned) a + (unsigned) b); break;
+    case MINUS: *val = (int) ((unsigned) a - (unsigned) b); break;
+    case TIMES: *val = (int) ((unsigned) a * (unsigned) b); break;
+    case OVER:
+      if ((b == 0) || ((b == -1) && (a == INT_MIN))) return FALSE;
+      *val = a / b;
+      break;
+    case LT: *val = a < b; break;
+    case LE: *val = a <= b; break;
+    case GT: *val = a > b; break;
+    case GE: *val = a >= b; break;
+    case EQ: *val = a == b; break;
+    case NE: *val = a != b; break;
+    default: return FALSE;
+  }
+  return TRUE;
+}
+
+/* Function simplify returns the operand of t
+ * when t is x+0, 0+x, x-0, x*1, 1*x or x/1, and
+ * makes x*0 and 0*x the constant 0 when x has no
+ * effect; otherwise it returns t
+ */
+static TreeNode * simplify( TreeNode * t )
+{ TreeNode * p1 = t->child[0];
+  TreeNode * p2 = t->child[1];
+  TreeNode * keep = NULL;
+  switch (t->attr.op)
+  { case PLUS:
+      if (isConstVal(p2,0)) keep = p1;
+      else if (isConstVal(p1,0)) keep = p2;
+      break;
+    case MINUS:
+      if (isConstVal(p2,0)) keep = p1;
+      break;
+    case TIMES:
+      if (isConstVal(p2,1)) keep = p1;
+      else if (isConstVal(p1,1)) keep = p2;
+      else if ((isConstVal(p2,0) && ! hasEffect(p1))
+               || (isConstVal(p1,0) && ! hasEffect(p2)))
+      { t->kind.exp = ConstK;
+        t->attr.val = 0;
+        t->child[0] = t->child[1] = NULL;
+        numSimplified++;
+      }
+      break;
+    case OVER:
+      if (isConstVal(p2,1)) keep = p1;
+      break;
+    default:
+      break;
+  }
+  if (keep == NULL) return t;
+  keep->sibling = t->sibling;
+  numSimplified++;
+  return keep;
+}
+
+static TreeNode * foldList( TreeNode * t );
+
+/* Function foldExp folds expression t bottom-up
+ * and returns the tree that replaces it
+ */
+static TreeNode * foldExp( TreeNode * t )
+{ int val;
+  if (t == NULL) return NULL;
+  switch (t->kind.exp)
+  { case OpK:
+      t->child[0] = foldExp(t->child[0]);
+      t->child[1] = foldExp(t->child[1]);
+      if (isConst(t->child[0]) && isConst(t->child[1])
+          && evalOp(t->attr.op,t->child[0]->attr.val,
+                    t->child[1]->attr.val,&val))
+      { t->kind.exp = ConstK;
+        t->attr.val = val;
+        t->child[0] = t->child[1] = NULL;
+        numFolded++;
+        return t;
+      }
+      return simplify(t);
+    case CallK:
+      t->child[0] = foldList(t->child[0]);
+      return t;
+    case AssignK:
+    case ArrIdK:
+      t->child[0] = foldExp(t->child[0]);
+      t->child[1] = foldExp(t->child[1]);
+      return t;
+    default:
+      return t;
+  }
+}
+
+/* Function foldStmt folds statement t and returns
+ * the statement that replaces it, or NULL if it
+ * can be dropped
+ */
+static TreeNode * foldStmt( TreeNode * t )
+{ TreeNode * cond;
+  if (t == NULL) return NULL;
+  switch (t->nodekind)
+  { case StmtK:
+      switch (t->kind.stmt)
+      { case CompK:
+          t->child[1] = foldList(t->child[1]);
+          return t;
+        case IfK:
+          cond = t->child[0] = foldExp(t->child[0]);
+          t->child[1] = foldStmt(t->child[1]);
+          t->child[2] = foldStmt(t->child[2]);
+          if (! isConst(cond)) return t;
+          numBranches++;
+          return cond->attr.val ? t->child[1] : t->child[2];
+        case IterK:
+          cond = t->child[0] = foldExp(t->child[0]);
+          t->child[1] = foldStmt(t->child[1]);
+          if (! isConstVal(cond,0)) return t;
+          numBranches++;
+          return NULL;
+        case RetK:
+          t->child[0] = foldExp(t->child[0]);
+          return t;
+        default:
+          return t;
+      }
+    case ExpK:
+      return foldExp(t);
+    case DeclK:
+      if (t->kind.decl == FuncK)
+        t->child[2] = foldStmt(t->child[2]);
+      return t;
+    default:
+      return t;
+  }
+}
+
+/* Function foldList folds each tree of the
+ * sibling list t and returns the new list
+ */
+static TreeNode * foldList( TreeNode * t )
+{ TreeNode * head = NULL;
+  TreeNode ** link = &head;
+  TreeNode * next, * r;
+  while (t != NULL)
+  { next = t->sibling;
+    t->sibling = NULL;
+    r = (t->nodekind == ExpK) ? foldExp(t) : foldStmt(t);
+    if (r != NULL)
+    { *link = r;
+      link = &r->sibling;
+    }
+    t = next;
+  }
+  *link = NULL;
+  return head;
+}
+
+/* Procedure optimize folds the syntax tree in
+ * place; declarations are never replaced, so the
+ * root stays the same
+ */
+void optimize( TreeNode * syntaxTree )
+{ foldList(syntaxTree);
+  if (TraceAnalyze)
+    fprintf(listing,
+            "Folded %d constant expressions, %d simplifications, "
+            "%d constant branches\n",
+            numFolded,numSimplified,numBranches);
+}
@@ -0,0 +1,17 @@
+/****************************************************/
+/* File: opt.h                                      */
+/* Syntax tree optimizer interface for the C-Minus  */
+/* compiler                                         */
+/****************************************************/
+
+#ifndef _OPT_H_
+#define _OPT_H_
+
+/* Procedure optimize folds constant expressions,
+ * simplifies trivial arithmetic and removes
+ * branches with constant conditions in the
+ * type-checked syntax tree
+ */
+void optimize(TreeNode *);
+
+#endif
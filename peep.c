@@ -0,0 +1,325 @@
+/****************************************************/
+/* File: peep.c                                     */
+/* Peephole optimizer over the buffered TM code     */
+/* for the C-Minus compiler                         */
+/****************************************************/
+
+#include "globals.h"
+#include "code.h"
+#include "peep.h"
+
+/* the code buffer being optimized (see emitBuffer) */
+static TMInstr * buf;
+static int size;
+
+/* label[loc] is TRUE if some jump or code
+ * location refers to loc, i.e. control can
+ * reach loc other than from loc-1
+ */
+static char * label;
+
+/* zeroOK is TRUE if register zero is only
+ * loaded by the standard prelude (so it is 0);
+ * a unit has no prelude, the linker adds it
+ */
+static int zeroOK;
+
+/* Function live returns the first location
+ * at or after loc that was not deleted
+ */
+static int live( int loc )
+{ while ((loc < size) && (buf[loc].op < 0)) loc++;
+  return loc;
+}
+
+/* Function next returns the next location
+ * after loc that was not deleted
+ */
+static int next( int loc )
+{ return live(loc+1);
+}
+
+/* Procedure delete removes the instruction at
+ * loc; jumps to it now reach the next one
+ */
+static void delete( int loc )
+{ buf[loc].op = -1;
+  if (label[loc]) label[next(loc)] = TRUE;
+}
+
+/* Function target returns the code location
+ * in.arg2 refers to for jumps and code locations,
+ * or -1
+ */
+static int target( TMInstr * in, int loc )
+{ if (in->isLoc) return in->arg2;
+  if ((in->op >= tmLDA) && (in->op != tmLDC) && (in->arg3 == pc))
+    return loc+1+in->arg2;
+  return -1;
+}
+
+static int isCondJump( TMInstr * in )
+{ return (in->op >= tmJLT) && (in->op <= tmJNE);
+}
+
+/* Function writes tells whether in writes register r */
+static int writes( TMInstr * in, int r )
+{ switch (in->op)
+  { case tmIN: case tmADD: case tmSUB: case tmMUL: case tmDIV:
+    case tmLD: case tmLDA: case tmLDC:
+      return in->arg1 == r;
+    default:
+      return FALSE;
+  }
+}
+
+/* Function reads tells whether in reads register r */
+static int reads( TMInstr * in, int r )
+{ switch (in->op)
+  { case tmOUT:
+      return in->arg1 == r;
+    case tmADD: case tmSUB: case tmMUL: case tmDIV:
+      return (in->arg2 == r) || (in->arg3 == r);
+    case tmLD: case tmLDA:
+      return in->arg3 == r;
+    case tmST:
+      return (in->arg1 == r) || (in->arg3 == r);
+    case tmLDC: case tmHALT: case tmIN:
+      return FALSE;
+    default: /* conditional jumps */
+      return (in->arg1 == r) || (in->arg3 == r);
+  }
+}
+
+/* Function isJump tells whether control may
+ * leave in other than to the next instruction
+ */
+static int isJump( TMInstr * in )
+{ return (in->op == tmHALT) || isCondJump(in) || writes(in,pc);
+}
+
+/* Function isGoto tells whether in never
+ * continues with the next instruction
+ */
+static int isGoto( TMInstr * in )
+{ return (in->op == tmHALT) || (! isCondJump(in) && writes(in,pc));
+}
+
+/* Function dead tells whether register r is
+ * dead after loc: written before read on the
+ * straight-line path from loc
+ */
+static int dead( int loc, int r )
+{ TMInstr * in;
+  for (loc = next(loc); loc < size; loc = next(loc))
+  { in = &buf[loc];
+    if (reads(in,r)) return FALSE;
+    if (writes(in,r)) return TRUE;
+    if (in->op == tmHALT) return TRUE;
+    if (isJump(in)) return FALSE;
+  }
+  return TRUE;
+}
+
+/* Procedure findLabels recomputes label[] */
+static void findLabels(void)
+{ int loc, t;
+  memset(label,0,size+1);
+  label[0] = TRUE;
+  for (loc = live(0); loc < size; loc = next(loc))
+  { t = target(&buf[loc],loc);
+    if ((t >= 0) && (t <= size)) label[live(t)] = TRUE;
+  }
+}
+
+static void setRM( TMInstr * in, int op, int r, int d, int s )
+{ in->op = op;
+  in->isRO = FALSE;
+  in->isLoc = FALSE;
+  in->arg1 = r;
+  in->arg2 = d;
+  in->arg3 = s;
+}
+
+/* LDC y,k followed by ADD z,y,x / ADD z,x,y /
+ * SUB z,x,y / SUB z,zero,y becomes LDA z,+-k(x)
+ * (or LDC z,-k)
+ */
+static int foldConst( int i0 )
+{ TMInstr * c = &buf[i0];
+  TMInstr * in;
+  int i1 = next(i0);
+  int y, k, x;
+  if ((c->op != tmLDC) || c->isLoc || (c->reloc >= 0) || (c->arg1 == pc)
+      || (i1 >= size))
+    return FALSE;
+  in = &buf[i1];
+  if (label[i1]) return FALSE;
+  y = c->arg1;
+  k = c->arg2;
+  if ((in->op == tmADD) && (in->arg2 == y) && (in->arg3 != y))
+    x = in->arg3;
+  else if ((in->op == tmADD) && (in->arg3 == y) && (in->arg2 != y))
+    x = in->arg2;
+  else if ((in->op == tmSUB) && (in->arg3 == y) && (in->arg2 != y))
+  { x = in->arg2;
+    k = -k;
+  }
+  else return FALSE;
+  if ((x == pc) || (in->arg1 == pc)) return FALSE;
+  if ((in->arg1 != y) && ! dead(i1,y)) return FALSE;
+  if ((x == zero) && (in->op == tmSUB) && zeroOK)
+    setRM(in,tmLDC,in->arg1,k,0);
+  else
+    setRM(in,tmLDA,in->arg1,k,x);
+  delete(i0);
+  return TRUE;
+}
+
+/* LDA y,a(b) whose value is next used only as
+ * the base of LD/ST/LDA z,d(y) is folded into
+ * that instruction as z,a+d(b), which takes
+ * over the relocation of a
+ */
+static int foldAddress( int i0 )
+{ TMInstr * a = &buf[i0];
+  TMInstr * in;
+  int y = a->arg1, b = a->arg3;
+  int loc;
+  if ((a->op != tmLDA) || (y == pc) || (b == pc) || (y == b))
+    return FALSE;
+  for (loc = next(i0); loc < size; loc = next(loc))
+  { in = &buf[loc];
+    if (label[loc] || isJump(in)) return FALSE;
+    if (reads(in,y))
+    { if (((in->op != tmLD) && (in->op != tmST) && (in->op != tmLDA))
+          || (in->arg3 != y)
+          || ((in->op == tmST) && (in->arg1 == y)))
+        return FALSE;
+      if ((in->arg1 != y) && ! dead(loc,y)) return FALSE;
+      if ((a->reloc >= 0) && (in->reloc >= 0)) return FALSE;
+      in->arg2 += a->arg2;
+      in->arg3 = b;
+      if (a->reloc >= 0)
+      { in->reloc = a->reloc;
+        in->relocKind = a->relocKind;
+      }
+      delete(i0);
+      return TRUE;
+    }
+    if (writes(in,y) || writes(in,b)) return FALSE;
+  }
+  return FALSE;
+}
+
+/* ST x,0(sp); LDA sp,-1(sp); W...; LDA sp,1(sp);
+ * LD y,0(sp) becomes LDA y,0(x); W... when the
+ * straight-line code W leaves sp and y alone
+ */
+#define MAX_PUSH_BODY 8
+
+static int foldPushPop( int i0 )
+{ TMInstr * st = &buf[i0];
+  TMInstr * in;
+  int i1, i3, i4, loc, n = 0;
+  int x = st->arg1, y;
+  if ((st->op != tmST) || (st->arg2 != 0) || (st->arg3 != sp)
+      || (x == sp) || (x == pc))
+    return FALSE;
+  i1 = next(i0);
+  if ((i1 >= size) || label[i1]) return FALSE;
+  in = &buf[i1];
+  if ((in->op != tmLDA) || (in->arg1 != sp) || (in->arg2 != -1)
+      || (in->arg3 != sp))
+    return FALSE;
+  for (loc = next(i1); loc < size; loc = next(loc))
+  { in = &buf[loc];
+    if (label[loc] || isJump(in)) return FALSE;
+    if ((in->op == tmLDA) && (in->arg1 == sp) && (in->arg2 == 1)
+        && (in->arg3 == sp))
+      break;
+    if (reads(in,sp) || writes(in,sp) || (in->op == tmST)
+        || (in->op == tmIN) || (in->op == tmOUT)
+        || (++n > MAX_PUSH_BODY))
+      return FALSE;
+  }
+  i3 = loc;
+  i4 = next(i3);
+  if ((i3 >= size) || (i4 >= size) || label[i4]) return FALSE;
+  in = &buf[i4];
+  if ((in->op != tmLD) || (in->arg2 != 0) || (in->arg3 != sp)
+      || (in->arg1 == sp) || (in->arg1 == pc))
+    return FALSE;
+  y = in->arg1;
+  for (loc = next(i1); loc < i3; loc = next(loc))
+    if (reads(&buf[loc],y) || writes(&buf[loc],y)) return FALSE;
+  if (x == y) delete(i0);
+  else setRM(st,tmLDA,y,0,x);
+  delete(i1);
+  delete(i3);
+  delete(i4);
+  return TRUE;
+}
+
+/* a jump to the next instruction, or a register
+ * copy to itself, does nothing
+ */
+static int foldNop( int i0 )
+{ TMInstr * in = &buf[i0];
+  int t;
+  if ((in->op == tmLDA) && (in->arg1 == in->arg3) && (in->arg2 == 0)
+      && ! in->isLoc && (in->reloc < 0))
+  { delete(i0);
+    return TRUE;
+  }
+  if (! isCondJump(in) && ! writes(in,pc)) return FALSE;
+  t = target(in,i0);
+  if ((t < 0) || (live(t) != next(i0))) return FALSE;
+  delete(i0);
+  return TRUE;
+}
+
+/* code after an unconditional jump that no
+ * jump refers to is never executed
+ */
+static int foldUnreachable( int i0 )
+{ int loc, done = FALSE;
+  if (! isGoto(&buf[i0])) return FALSE;
+  for (loc = next(i0); (loc < size) && ! label[loc]; loc = next(loc))
+  { delete(loc);
+    done = TRUE;
+  }
+  return done;
+}
+
+/* Procedure peephole optimizes the buffered
+ * TM code until no pattern applies
+ */
+void peephole(void)
+{ int loc, changed, writers = 0;
+  int before = 0, after = 0;
+  buf = emitBuffer(&size);
+  label = malloc(size+1);
+  for (loc = 0; loc < size; loc++)
+    if (buf[loc].op >= 0)
+    { before++;
+      if (writes(&buf[loc],zero)) writers++;
+    }
+  zeroOK = (writers <= 1);
+  do
+  { changed = FALSE;
+    findLabels();
+    for (loc = live(0); loc < size; loc = next(loc))
+    { if (foldConst(loc) || foldAddress(loc) || foldPushPop(loc)
+          || foldNop(loc) || foldUnreachable(loc))
+        changed = TRUE;
+    }
+  } while (changed);
+  free(label);
+  emitRelocate();
+  buf = emitBuffer(&size);
+  after = size;
+  if (TraceCode)
+    fprintf(listing,"\nPeephole: %d instructions, %d removed\n",
+            after,before-after);
+}
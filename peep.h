@@ -0,0 +1,18 @@
+/****************************************************/
+/* File: peep.h                                     */
+/* Peephole optimizer interface for the C-Minus     */
+/* compiler                                         */
+/****************************************************/
+
+#ifndef _PEEP_H_
+#define _PEEP_H_
+
+/* Procedure peephole rewrites the buffered TM code
+ * (see emitBuffer): it folds constant and address
+ * arithmetic into LDA/LD/ST displacements, removes
+ * push/pop pairs around straight-line code, jumps
+ * to the next instruction and unreachable code
+ */
+void peephole(void);
+
+#endif
@@ -11,16 +11,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
 #include "symtab.h"
+#include "util.h"
 
 /* SHIFT is the power of two used as multiplier
    in hash function  */
 #define SHIFT 4
 
 
-#define MAX_NESTED_LEVEL 10 
-
-
 /* the hash function */
 static int hash ( char * key )
 { int temp = 0;
@@ -32,10 +31,136 @@ static int hash ( char * key )
   return temp;
 }
 
+/* The string table holds one copy of each
+ * identifier in the arena, after its hash; the
+ * table itself is chained on a second hash
+ */
+typedef struct NameRec
+   { struct NameRec * next;
+     unsigned key;  /* string table hash */
+     int hash;      /* symbol table hash */
+     char text[1];
+   } NameRec;
+
+#define NAME_REC(s) ((NameRec *) ((s) - offsetof(NameRec,text)))
+
+static NameRec ** names = NULL;
+static unsigned namesSize = 0;
+static unsigned namesCount = 0;
+
+/* Procedure growNames doubles the string table */
+static void growNames(void)
+{ unsigned size = namesSize ? 2*namesSize : 1024;
+  NameRec ** t = calloc(size, sizeof(NameRec *));
+  NameRec * n, * next;
+  unsigned i;
+  for (i = 0; i < namesSize; i++)
+    for (n = names[i]; n != NULL; n = next)
+    { next = n->next;
+      n->next = t[n->key & (size-1)];
+      t[n->key & (size-1)] = n;
+    }
+  free(names);
+  names = t;
+  namesSize = size;
+}
+
+char * st_intern( char * s )
+{ unsigned key = 2166136261u;
+  int len;
+  NameRec * n;
+  for (len = 0; s[len] != '\0'; len++)
+    key = (key ^ (unsigned char) s[len]) * 16777619u;
+  if (namesCount >= namesSize) growNames();
+  for (n = names[key & (namesSize-1)]; n != NULL; n = n->next)
+    if ((n->key == key) && (strcmp(n->text, s) == 0))
+      return n->text;
+  n = arenaAlloc(offsetof(NameRec,text) + len + 1);
+  n->key = key;
+  n->hash = hash(s);
+  memcpy(n->text, s, len + 1);
+  n->next = names[key & (namesSize-1)];
+  names[key & (namesSize-1)] = n;
+  namesCount++;
+  return n->text;
+} /* st_intern */
+
+/* A scope keeps its symbols in insertion order;
+ * a scope with more than SCOPE_SCAN symbols also
+ * gets an open addressing index by name
+ */
+#define SCOPE_SCAN 8
+
+/* Function newScope allocates an empty scope */
+static Scope newScope(char * name, Scope parent)
+{ Scope s = (Scope) calloc(1, sizeof(struct ScopeListRec));
+  s->name = st_intern(name);
+  s->parent = parent;
+  s->nested_level = (parent != NULL) ? parent->nested_level + 1 : 0;
+  return s;
+}
+
+/* Procedure indexSymbol enters l in the index of scope */
+static void indexSymbol(Scope scope, BucketList l)
+{ unsigned i = NAME_REC(l->name)->key & (scope->indexSize-1);
+  while (scope->index[i] != NULL) i = (i+1) & (scope->indexSize-1);
+  scope->index[i] = l;
+}
+
+/* Procedure addSymbol appends l to scope, building
+ * or doubling the index when it is needed
+ */
+static void addSymbol(Scope scope, BucketList l)
+{ int i;
+  if (scope->numSyms == scope->symCap)
+  { scope->symCap = scope->symCap ? 2*scope->symCap : 4;
+    scope->syms = realloc(scope->syms, scope->symCap*sizeof(BucketList));
+  }
+  scope->syms[scope->numSyms++] = l;
+  if (scope->numSyms <= SCOPE_SCAN) return;
+  if (2*scope->numSyms > scope->indexSize)
+  { free(scope->index);
+    scope->indexSize = scope->indexSize ? 2*scope->indexSize : 4*SCOPE_SCAN;
+    scope->index = calloc(scope->indexSize, sizeof(BucketList));
+    for (i = 0; i < scope->numSyms; i++) indexSymbol(scope, scope->syms[i]);
+  }
+  else indexSymbol(scope, l);
+}
+
+/* sort key for scopeSymbols: by hash, and
+ * the latest symbol first for equal hashes */
+static Scope sortScope;
+
+static int listingOrder(const void * a, const void * b)
+{ int x = *(int *) a, y = *(int *) b;
+  int hx = NAME_REC(sortScope->syms[x]->name)->hash;
+  int hy = NAME_REC(sortScope->syms[y]->name)->hash;
+  if (hx != hy) return hx - hy;
+  return y - x;
+}
+
+/* Function scopeSymbols returns a new vector of
+ * the n symbols of scope in listing order, the
+ * order of the former chained hash table
+ */
+static BucketList * scopeSymbols(Scope scope, int * n)
+{ int * order = malloc((scope->numSyms+1)*sizeof(int));
+  BucketList * v = malloc((scope->numSyms+1)*sizeof(BucketList));
+  int i;
+  for (i = 0; i < scope->numSyms; i++) order[i] = i;
+  sortScope = scope;
+  qsort(order, scope->numSyms, sizeof(int), listingOrder);
+  for (i = 0; i < scope->numSyms; i++) v[i] = scope->syms[order[i]];
+  free(order);
+  *n = scope->numSyms;
+  return v;
+}
+
 /* scope management stack */
 // all scopes are needed because of symbol table result printing
-static Scope all_scopes[256];
+static Scope * all_scopes = NULL;
 static int all_scope_num = 0;
+static int all_scope_cap = 0;
 static Scope cur_scope;
 static Scope global_scope = NULL;
 
@@ -43,34 +168,60 @@ static Scope global_scope = NULL;
 static int location = 2;
 static int global_location = 1;
 
+/* Procedure addLine appends lineno to lines */
+static void addLine(LineVec * lines, int lineno)
+{ if (! TraceAnalyze) return;
+  if (lines->num == lines->cap)
+  { lines->cap = lines->cap ? 2*lines->cap : 4;
+    lines->lineno = realloc(lines->lineno, lines->cap*sizeof(int));
+  }
+  lines->lineno[lines->num++] = lineno;
+}
+
+/* Procedure addScope records scope in all_scopes */
+static void addScope(Scope scope)
+{ if (all_scope_num == all_scope_cap)
+  { all_scope_cap = all_scope_cap ? 2*all_scope_cap : 64;
+    all_scopes = realloc(all_scopes, all_scope_cap*sizeof(Scope));
+  }
+  all_scopes[all_scope_num++] = scope;
+}
+
+/* Procedure addParam appends parameter p to the
+ * symbol of the function whose body is scope
+ */
+static void addParam(Scope scope, BucketList p)
+{ BucketList f;
+  if (scope->parent != global_scope) return;
+  f = st_lookup_excluding_parent(global_scope, scope->name);
+  if ((f == NULL) || (f->i_type != Func) || (f->scope != scope)) return;
+  if (f->numParams == f->paramCap)
+  { f->paramCap = f->paramCap ? 2*f->paramCap : 4;
+    f->params = realloc(f->params, f->paramCap*sizeof(BucketList));
+  }
+  f->params[f->numParams++] = p;
+}
+
 /* '0' is for fp, '1' is for mp */
 void init_memloc() {
   location = 2;
 }
 
 void printBucketList(Scope scope) {
-    BucketList* l = scope->bucket;
-    BucketList tmp = NULL;
     int i;
-    for (i = 0; i < SIZE; i++) {
-        if (l[i] != NULL) {
-            tmp = l[i];
-            while(tmp) {
-                tmp = tmp->next;
-            }
-        }
-    }
+    for (i = 0; i < scope->numSyms; i++)
+      fprintf(listing, "%s\n", scope->syms[i]->name);
 }
 
 
-/* Procedure st_insert inserts line numbers and
+/* Function st_insert inserts line numbers and
  * memory locations into the symbol table
  * loc = memory location is inserted only the
- * first time, otherwise ignored
+ * first time, otherwise ignored; it returns
+ * the symbol
  */
-void st_insert( Scope scope, TreeNode *tree, ExpType type, IdType i_type, int param_opt ) {
+BucketList st_insert( Scope scope, TreeNode *tree, ExpType type, IdType i_type, int param_opt ) {
   char* name;
-  int h;
   
   /* not array */
   if (tree->kind.decl != ArrVarK) {
@@ -80,29 +231,31 @@ void st_insert( Scope scope, TreeNode *tree, ExpType type, IdType i_type, int pa
     name = tree->attr.arr.name;
   }
 
-  h = hash(name);
   BucketList l;
   Scope tmp_scope;
 
-  l = scope->bucket[h];
-  while ((l != NULL) && (strcmp(name,l->name) != 0)) {
-    l = l->next;
-  }
+  l = st_lookup_excluding_parent(scope, name);
 
   if (l == NULL) { /* variable not yet in table */
     l = (BucketList) malloc(sizeof(struct BucketListRec));
     l->name = name;
-    l->lines = (LineList) malloc(sizeof(struct LineListRec));
-    l->lines->lineno = tree->lineno;
+    l->lines.lineno = NULL;
+    l->lines.num = l->lines.cap = 0;
+    addLine(&l->lines, tree->lineno);
     l->type = type;
-    l->lines->next = NULL;
-    l->next = NULL;
     l->i_type = i_type;
+    l->params = NULL;
+    l->numParams = l->paramCap = 0;
+    l->scope = NULL;
+    l->defined = l->called = FALSE;
+    l->memloc = 0; /* parameters have no memloc */
+    l->size = 0;
     if (scope == global_scope) {
       if (type != IntegerArray) {
         l->memloc = global_location++; 
       }
       else {
+        l->size = tree->attr.arr.size;
         global_location = global_location + tree->attr.arr.size;
         l->memloc = global_location;
         global_location++;
@@ -116,13 +269,14 @@ void st_insert( Scope scope, TreeNode *tree, ExpType type, IdType i_type, int pa
         }
         /* in case Integer Array */
         else {
+          l->size = tree->attr.arr.size;
           l->memloc = location;
           location = location + tree->attr.arr.size;
           location ++;
         }
         scope->mem_size = location;
         tmp_scope = sc_top();
-        while (strcmp(scope->name, tmp_scope->name) == 0) {
+        while (scope->name == tmp_scope->name) {
           /* when function's name is same */
           tmp_scope->mem_size = location;
           tmp_scope = tmp_scope->parent;
@@ -139,43 +293,37 @@ void st_insert( Scope scope, TreeNode *tree, ExpType type, IdType i_type, int pa
     if (param_opt != -1) {
       scope->max_param_num = param_opt+1;
     }
-    l->next = scope->bucket[h];
-    scope->bucket[h] = l;
+    addSymbol(scope, l);
+    if (i_type == ParamVar) addParam(scope, l);
   }
   else /* found in table, so just add line number */
-  { LineList t = l->lines;
-    while (t->next != NULL) t = t->next;
-    t->next = (LineList) malloc(sizeof(struct LineListRec));
-    t->next->lineno = lineno;
-    t->next->next = NULL;
-  }
+    addLine(&l->lines, lineno);
+  return l;
 } /* st_insert */
 
 /* Function st_lookup returns the memory 
  * location of a variable or -1 if not found
  */
 BucketList st_lookup_excluding_parent (Scope scope, char * name )
-{ int h = hash(name);
-
-  BucketList l =  scope->bucket[h];
-  while ((l != NULL) && (strcmp(name,l->name) != 0))
-    l = l->next;
-  if (l == NULL) return NULL;
-  else return l;
-}
-
-void bucket_init(BucketList bucket_list[]) {
-  int i;
-  for(i = 0; i < SIZE; i++) {
-    bucket_list[i] = NULL;
+{ unsigned i;
+  BucketList l;
+  if (scope->index == NULL) {
+    for (i = 0; i < scope->numSyms; i++)
+      if (scope->syms[i]->name == name) return scope->syms[i];
+    return NULL;
   }
+  i = NAME_REC(name)->key & (scope->indexSize-1);
+  while ((l = scope->index[i]) != NULL) {
+    if (l->name == name) return l;
+    i = (i+1) & (scope->indexSize-1);
+  }
+  return NULL;
 }
 
 BucketList st_lookup (Scope scope, char *name )
 {
     Scope s = scope;
-    int h = hash(name);
-    BucketList l = scope->bucket[h];
+    BucketList l;
 
     while(s) {
         l = st_lookup_excluding_parent(s, name);
@@ -187,8 +335,7 @@ BucketList st_lookup (Scope scope, char *name )
 
 Scope find_scope_by_var(Scope scope, char *name) {
     Scope s = scope;
-    int h = hash(name);
-    BucketList l = scope->bucket[h];
+    BucketList l;
 
     while(s) {
         // printf("%s searching... \n", s->name);
@@ -210,8 +357,7 @@ int is_in_global_scope(BucketList l) {
 
 char* find_scope_name_by_var(Scope scope, char *name ) {
     Scope s = scope;
-    int h = hash(name);
-    BucketList l = scope->bucket[h];
+    BucketList l;
 
     while(s) {
         // printf("%s searching... \n", s->name);
@@ -223,27 +369,24 @@ char* find_scope_name_by_var(Scope scope, char *name ) {
     return NULL;
 }
 
-void get_param_list(char* name, BucketList* param_list) {
-    Scope scope = search_in_all_scope(name);
+BucketList st_lookup_function (char * name)
+{ BucketList l = st_lookup_excluding_parent(global_scope, name);
+  if ((l == NULL) || (l->i_type != Func)) return NULL;
+  return l;
+}
 
-    if (scope == NULL) {
-        param_list = NULL;
-        return ;
-    }
-    BucketList* ht = scope->bucket;
-    int i;
-    int j=0;
-    for (i=0;i<SIZE;i++) {
-      if (ht[i] !=NULL) {
-        BucketList l = ht[i];
-        while(l != NULL) {
-          if (l->i_type == ParamVar) {
-            param_list[j++] = l;
-          }
-          l = l->next;
-        }
-      }      
-    }
+/* Function st_undefined_function returns a
+ * function that is called but only declared
+ * by a prototype, or NULL if there is none
+ */
+BucketList st_undefined_function (void)
+{ int i;
+  BucketList l;
+  for (i = 0; i < global_scope->numSyms; i++)
+  { l = global_scope->syms[i];
+    if ((l->i_type == Func) && l->called && ! l->defined) return l;
+  }
+  return NULL;
 }
 
 /* Procedure sc_init process
@@ -258,16 +401,10 @@ void sc_init() {
     TreeNode *arg;
 
     if (global_scope == NULL) {
-        global_scope = (Scope) malloc(sizeof(struct ScopeListRec));
-        
-        // input scope name, nested_level and set parent = NULL;
-        sprintf(global_scope->name, "global");
-        global_scope->nested_level = 0;
-        bucket_init(global_scope->bucket);
-        global_scope->parent = NULL;
+        global_scope = newScope("global", NULL);
 
         // to printing symbol table
-        all_scopes[all_scope_num++] = global_scope;
+        addScope(global_scope);
 
         cur_scope = global_scope;
         
@@ -275,22 +412,19 @@ void sc_init() {
         input_function = (TreeNode*)malloc(sizeof(TreeNode));
         output_function = (TreeNode*)malloc(sizeof(TreeNode));
         arg = (TreeNode*)malloc(sizeof(TreeNode));
-        input_function->attr.name = (char*)malloc(sizeof(char)*10);
-        output_function->attr.name = (char*)malloc(sizeof(char)*10);
-        arg->attr.name = (char*)malloc(sizeof(char)*10);
-        sprintf(input_function->attr.name, "input");
-        sprintf(output_function->attr.name, "output");
-        sprintf(arg->attr.name, "arg");
+        input_function->attr.name = st_intern("input");
+        output_function->attr.name = st_intern("output");
+        arg->attr.name = st_intern("arg");
         input_function->lineno = -1;
         output_function->lineno = -1;
         arg->lineno = -1;
 
-        st_insert(sc_top(), input_function, Integer, Func, -1);
+        st_insert(sc_top(), input_function, Integer, Func, -1)->defined = TRUE;
         sc_push("input", 0);
         sc_top()->mem_size = 2;
         sc_pop();
 
-        st_insert(sc_top(), output_function, Void, Func, -1);
+        st_insert(sc_top(), output_function, Void, Func, -1)->defined = TRUE;
         sc_push("output", 0);
         st_insert(sc_top(), arg, Integer, ParamVar, 0);
         sc_pop();
@@ -311,16 +445,27 @@ void sc_push(char* scope, int nested_level) {
     else
          printf("%s scope is pushed\n", scope);
     */
-    Scope new_scope = (Scope) malloc(sizeof(struct ScopeListRec));
-    strcpy(new_scope->name, scope);
-    new_scope->nested_level = cur_scope->nested_level + 1;
-    bucket_init(new_scope->bucket);
-    new_scope->parent = cur_scope;
+    Scope new_scope = newScope(scope, cur_scope);
+    BucketList f;
+
+    /* the first scope under global named after a
+     * function is its body (a redeclared function
+     * keeps its first body); until the body is
+     * seen, it is the parameter scope of the
+     * latest prototype
+     */
+    if (cur_scope == global_scope) {
+      f = st_lookup_excluding_parent(global_scope, new_scope->name);
+      if ((f != NULL) && ((f->scope == NULL) || ! f->defined)) {
+        f->scope = new_scope;
+        f->numParams = 0;
+      }
+    }
 
     cur_scope = new_scope;
 
     // to printing symbol table result
-    all_scopes[all_scope_num++] = new_scope;
+    addScope(new_scope);
 }
 
 void sc_pop() {
@@ -337,188 +482,168 @@ void set_cur_scope(Scope scope)
 }
 
 Scope search_in_all_scope(char* scope) {
-    int i;
-    int count = 0;
-
-    for(i=0;i<all_scope_num;i++) {
-        if(!strcmp(all_scopes[i]->name, scope)) {
-            return all_scopes[i];
-        }
-    }
-    return NULL;
+    BucketList f = st_lookup_excluding_parent(global_scope, scope);
+    return (f != NULL) ? f->scope : NULL;
 }
 
 
 void print_scope(Scope scope, IdType i_type) {
-    BucketList* ht = scope->bucket;
+    int n;
+    BucketList* ht = scopeSymbols(scope, &n);
     int i;
 
-    printf("\nparam           paramtype\n");
-    printf("--------        ------------------\n");
-    for (i=0;i<SIZE;i++) {
-      if (ht[i] !=NULL) {
-        BucketList l = ht[i];
-        while(l != NULL) {
-          if(l->i_type == i_type) {
-            printf("%-15s ", l->name);
-            switch (l->type) {
-              case Integer:
-                fprintf(listing, "%-11s ", "Integer");
-                break;
-              case Void:
-                fprintf(listing, "%-11s ", "Void");
-                break;
-              case IntegerArray:
-                fprintf(listing, "%-11s ", "IntegerArray");
-                break;
-              case Err:
-                fprintf(listing, "%-11s ", "error");
-                break;
-             }
-             printf("\n");
-          }
-          l = l->next;
-        }
+    fprintf(listing, "\nparam           paramtype\n");
+    fprintf(listing, "--------        ------------------\n");
+    for (i=0;i<n;i++) {
+      BucketList l = ht[i];
+      if(l->i_type == i_type) {
+        fprintf(listing, "%-15s ", l->name);
+        switch (l->type) {
+          case Integer:
+            fprintf(listing, "%-11s ", "Integer");
+            break;
+          case Void:
+            fprintf(listing, "%-11s ", "Void");
+            break;
+          case IntegerArray:
+            fprintf(listing, "%-11s ", "IntegerArray");
+            break;
+          case Err:
+            fprintf(listing, "%-11s ", "error");
+            break;
+         }
+         fprintf(listing, "\n");
       }
     }
+    free(ht);
 }
 
 void print_function_declaration(FILE * listing) {
  
   Scope tmp_scope = NULL;
-  BucketList* g_ht = global_scope->bucket;
+  int n;
+  BucketList* g_ht = scopeSymbols(global_scope, &n);
   int i;
   fprintf(listing, "\n<FUNCTION DECLARATION>\n");
-  for (i=0;i<SIZE;i++) {
-   if (g_ht[i] != NULL)
-      { BucketList l = g_ht[i];
-        while (l != NULL) {
-          if(l->i_type == Func)
-          {  fprintf(listing,"function Name   Type   \n");
-             fprintf(listing,"-------------   -------\n");
-             fprintf(listing,"%-15s ",l->name);
-             switch (l->type) {
-              case Integer:
-                fprintf(listing, "%-11s ", "Int");
-                break;
-              case Void:
-                fprintf(listing, "%-11s ", "Void");
-                break;
-              case IntegerArray:
-                fprintf(listing, "%-11s ", "IntArray");
-                break;
-              case Err:
-                fprintf(listing, "%-11s ", "error");
-                break;
-             }
-             tmp_scope = search_in_all_scope(l->name);
-             print_scope(tmp_scope, ParamVar);
-             printf("\n");
-          }
-          l = l->next;
-        }
-      } 
+  for (i=0;i<n;i++) {
+    BucketList l = g_ht[i];
+    if(l->i_type == Func)
+    {  fprintf(listing,"function Name   Type   \n");
+       fprintf(listing,"-------------   -------\n");
+       fprintf(listing,"%-15s ",l->name);
+       switch (l->type) {
+        case Integer:
+          fprintf(listing, "%-11s ", "Int");
+          break;
+        case Void:
+          fprintf(listing, "%-11s ", "Void");
+          break;
+        case IntegerArray:
+          fprintf(listing, "%-11s ", "IntArray");
+          break;
+        case Err:
+          fprintf(listing, "%-11s ", "error");
+          break;
+       }
+       tmp_scope = l->scope;
+       print_scope(tmp_scope, ParamVar);
+       fprintf(listing, "\n");
+    }
   }
+  free(g_ht);
 }
 
 void print_function_and_global_var(FILE * listing) {
-  BucketList* g_ht = global_scope->bucket;
+  int n;
+  BucketList* g_ht = scopeSymbols(global_scope, &n);
 
   fprintf(listing, "\n<FUNCTION AND GLOBAL VAR>\n");
   fprintf(listing, "Name          Type          Data Type\n");
   fprintf(listing, "-------       ---------     ---------------\n");
 
   int i;
-  for (i=0;i<SIZE;i++) {
-   if (g_ht[i] != NULL){ 
-     BucketList l = g_ht[i];
-     while (l != NULL) {
-       fprintf(listing,"%-13s ",l->name);
-       switch (l->i_type) {
-         case NormalVar:
-           fprintf(listing, "%-13s ", "Variable");
-           break;
-         case Func:
-           fprintf(listing, "%-13s " ,"Function");
-           break;
-         default:
-           break;
-       }
-       switch (l->type) {
-         case Integer:
-           fprintf(listing, "%-11s ", "Int");
-           break;
-         case Void:
-           fprintf(listing, "%-11s ", "Void");
-           break;
-         case IntegerArray:
-           fprintf(listing, "%-11s ", "IntArray");
-           break;
-         case Err:
-           fprintf(listing, "%-11s ", "error");
-           break;
-         default:
-           break;
-       }
-       fprintf(listing, "!!%4d ", l->memloc);
-       fprintf(listing, "\n");
-       l = l->next;
-     }
-   }
+  for (i=0;i<n;i++) {
+    BucketList l = g_ht[i];
+    fprintf(listing,"%-13s ",l->name);
+    switch (l->i_type) {
+      case NormalVar:
+        fprintf(listing, "%-13s ", "Variable");
+        break;
+      case Func:
+        fprintf(listing, "%-13s " ,"Function");
+        break;
+      default:
+        break;
+    }
+    switch (l->type) {
+      case Integer:
+        fprintf(listing, "%-11s ", "Int");
+        break;
+      case Void:
+        fprintf(listing, "%-11s ", "Void");
+        break;
+      case IntegerArray:
+        fprintf(listing, "%-11s ", "IntArray");
+        break;
+      case Err:
+        fprintf(listing, "%-11s ", "error");
+        break;
+      default:
+        break;
+    }
+    fprintf(listing, "!!%4d ", l->memloc);
+    fprintf(listing, "\n");
   }
+  free(g_ht);
 }
 
 void print_function_param_and_local_var(FILE* listing) {
   BucketList* ht;
-  int j, i;
+  int j, i, n;
 
   fprintf(listing, "\n<FUNCTION PARAM AND LOCAL VAR>\n");
 
   /* start point is 3 because 0, 1, 2 scope is global and built-in input, output */
   for(i=3;i<all_scope_num;i++) {
-    ht = all_scopes[i]->bucket;
+    ht = scopeSymbols(all_scopes[i], &n);
     fprintf(listing, "function name: %s (nested level: %d)\n", all_scopes[i]->name, all_scopes[i]->nested_level);
     fprintf(listing, "   ID Name      ID Type     Data Type\n");
     fprintf(listing, "------------  -----------  ------------\n");
-    for (j=0;j<SIZE;j++) {
-      if (ht[j] != NULL){ 
-        BucketList l = ht[j];
-        while (l != NULL) {
-          fprintf(listing,"%-13s ",l->name);
-          switch (l->i_type) {
-            case NormalVar:
-              fprintf(listing, "%-13s ", "Variable");
-              break;
-            case Func:
-              fprintf(listing, "%-13s " ,"Function");
-              break;
-            case ParamVar:
-              fprintf(listing, "%-13s ", "ParamVar");
-            default:
-              break;
-          }
-          switch (l->type) {
-            case Integer:
-              fprintf(listing, "%-11s ", "Int");
-              break;
-            case Void:
-              fprintf(listing, "%-11s ", "Void");
-              break;
-            case IntegerArray:
-              fprintf(listing, "%-11s ", "IntArray");
-              break;
-            case Err:
-              fprintf(listing, "%-11s ", "error");
-              break;
-            default:
-              break;
-          }
-          fprintf(listing, "!!%4d ", l->memloc);
-          fprintf(listing, "\n");
-          l = l->next;
-        }
+    for (j=0;j<n;j++) {
+      BucketList l = ht[j];
+      fprintf(listing,"%-13s ",l->name);
+      switch (l->i_type) {
+        case NormalVar:
+          fprintf(listing, "%-13s ", "Variable");
+          break;
+        case Func:
+          fprintf(listing, "%-13s " ,"Function");
+          break;
+        case ParamVar:
+          fprintf(listing, "%-13s ", "ParamVar");
+        default:
+          break;
+      }
+      switch (l->type) {
+        case Integer:
+          fprintf(listing, "%-11s ", "Int");
+          break;
+        case Void:
+          fprintf(listing, "%-11s ", "Void");
+          break;
+        case IntegerArray:
+          fprintf(listing, "%-11s ", "IntArray");
+          break;
+        case Err:
+          fprintf(listing, "%-11s ", "error");
+          break;
+        default:
+          break;
       }
+      fprintf(listing, "!!%4d ", l->memloc);
+      fprintf(listing, "\n");
     }
+    free(ht);
   }
 }
 
@@ -527,7 +652,7 @@ void print_function_param_and_local_var(FILE* listing) {
  * to the listing file
  */
 void printSymTab(FILE * listing)
-{ int i, j;
+{ int i, j, n;
   char* int_c = "Int";
   char* void_c = "Void";
   char* intarr_c = "IntArray";
@@ -546,37 +671,31 @@ void printSymTab(FILE * listing)
   fprintf(listing,"\n\nVariable Name   Type        Location      Scope        Line Numbers\n");
   fprintf(listing,"-------------   -------     --------      -------      ------------\n");
   for (j=0;j<all_scope_num;j++)
-  { BucketList* ht = all_scopes[j]->bucket;
-    for (i=0;i<SIZE;++i)
-    { if (ht[i] != NULL)
-      { BucketList l = ht[i];
-        while (l != NULL)
-        { LineList t = l->lines;
-          fprintf(listing,"%-15s ",l->name);
-          switch (l->type) {
-            case Integer:
-              fprintf(listing, "%-11s ", int_c);
-              break;
-            case Void:
-              fprintf(listing, "%-11s ", void_c);
-              break;
-            case IntegerArray:
-              fprintf(listing, "%-11s ", intarr_c);
-              break;
-            case Err:
-              fprintf(listing, "%-11s ", "error");
-              break;
-          }
-          fprintf(listing,"%-13d ",all_scopes[j]->nested_level);
-          fprintf(listing,"%-10s ",all_scopes[j]->name);
-          while (t != NULL)
-          { fprintf(listing,"%4d ",t->lineno);
-            t = t->next;
-          }
-          fprintf(listing,"\n");
-          l = l->next;
-        }
+  { BucketList* ht = scopeSymbols(all_scopes[j], &n);
+    for (i=0;i<n;++i)
+    { BucketList l = ht[i];
+      int k;
+      fprintf(listing,"%-15s ",l->name);
+      switch (l->type) {
+        case Integer:
+          fprintf(listing, "%-11s ", int_c);
+          break;
+        case Void:
+          fprintf(listing, "%-11s ", void_c);
+          break;
+        case IntegerArray:
+          fprintf(listing, "%-11s ", intarr_c);
+          break;
+        case Err:
+          fprintf(listing, "%-11s ", "error");
+          break;
       }
+      fprintf(listing,"%-13d ",all_scopes[j]->nested_level);
+      fprintf(listing,"%-10s ",all_scopes[j]->name);
+      for (k=0;k<l->lines.num;k++)
+        fprintf(listing,"%4d ",l->lines.lineno[k]);
+      fprintf(listing,"\n");
     }
+    free(ht);
   }
 } /* printSymTab */
@@ -11,23 +11,26 @@
 
 #include "globals.h"
 
+/* SIZE is the range of the listing hash */
 #define SIZE 256
 
-#define MAX_SCOPE_NUM 32
 #define CHAR_SIZE 128
 
 typedef enum { NormalVar, Func, ParamVar, Default } IdType;
 
-/* the list of line numbers of the source 
- * code in which a variable is referenced
+/* the line numbers of the source code in
+ * which a variable is referenced, packed in
+ * a vector of num entries that doubles when
+ * full; they are only kept for the listing,
+ * i.e. when TraceAnalyze is set
  */
-typedef struct LineListRec
-   { int lineno;
-     struct LineListRec * next;
-   } * LineList;
+typedef struct LineVecRec
+   { int * lineno;
+     int num, cap;
+   } LineVec;
 
 
-/* The record in the bucket lists for
+/* The record in a scope for
  * each variable, including name, 
  * assigned memory location, and
  * the list of line numbers in which
@@ -36,32 +39,52 @@ typedef struct LineListRec
 typedef struct BucketListRec
    { char * name;
      TokenType type;
-     LineList lines;
+     LineVec lines;
      int param_opt ; /* memory location for variable */
-     struct BucketListRec * next;
+     struct BucketListRec ** params; /* a function's parameters */
+     int numParams, paramCap;
+     struct ScopeListRec * scope; /* a function's body scope */
+     int defined; /* a function: its body has been seen */
+     int called;  /* a function: some call refers to it */
      IdType i_type;
      int memloc;
+     int size; /* an array: its number of elements */
    } * BucketList;
 
 /* The record for each scope,
- * including name, its bucket,
- * and parent scope
+ * including name, its symbols
+ * and parent scope; syms holds the
+ * numSyms symbols in insertion order,
+ * index (NULL while the scope is small)
+ * is an open addressing table on the
+ * name key with indexSize entries
  */
 typedef struct ScopeListRec
-   { char name[CHAR_SIZE];
+   { char * name; /* interned */
      int nested_level;
-     BucketList bucket[SIZE];
+     BucketList * syms;
+     int numSyms, symCap;
+     BucketList * index;
+     int indexSize;
      struct ScopeListRec * parent;
      int max_param_num;
      int mem_size;
    } * Scope;
 
-/* Procedure st_insert inserts line numbers and
+/* Function st_intern returns the unique copy of
+ * identifier s, which carries its hash; equal
+ * names get the same pointer. Every name given
+ * to the functions below must be interned
+ */
+char * st_intern( char * s );
+
+/* Function st_insert inserts line numbers and
  * memory locations into the symbol table
  * loc = memory location is inserted only the
- * first time, otherwise ignored
+ * first time, otherwise ignored; it returns
+ * the symbol
  */
-void st_insert(Scope scope, TreeNode* tree, ExpType type, IdType i_type,  int param_opt);
+BucketList st_insert(Scope scope, TreeNode* tree, ExpType type, IdType i_type,  int param_opt);
 
 /* Function st_lookup returns the memory 
  * location of a variable or -1 if not found
@@ -69,7 +92,22 @@ void st_insert(Scope scope, TreeNode* tree, ExpType type, IdType i_type,  int pa
 BucketList st_lookup (Scope scope, char * name );
 BucketList st_lookup_excluding_parent (Scope scope, char *name);
 
+/* Function st_lookup_function returns the
+ * global symbol of function name, whose
+ * params hold its numParams parameters,
+ * or NULL if there is none
+ */
+BucketList st_lookup_function (char * name);
+
+/* Function st_undefined_function returns a
+ * function that is called but only declared
+ * by a prototype, or NULL if there is none
+ */
+BucketList st_undefined_function (void);
+
 char* find_scope_name_by_var(Scope scope, char* var);
+Scope find_scope_by_var(Scope scope, char* var);
+int is_in_global_scope(BucketList l);
 
 /* To management scope
  * scope related function is needed
@@ -85,8 +123,6 @@ void set_cur_scope(Scope scope);
 
 void init_memloc();
 
-void bucket_init(BucketList bucket_list[]);
-
 
 /* Procedure printSymTab prints a formatted 
  * listing of the symbol table contents 
@@ -96,6 +132,9 @@ void printSymTab(FILE * listing);
 
 void printBucketList(Scope scope);
 
+/* Function search_in_all_scope returns the body
+ * scope of the function named scope, or NULL
+ */
 Scope search_in_all_scope(char* scope);
 
 
@@ -9,6 +9,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "tmobj.h"
 
 #ifndef TRUE
 #define TRUE 1
@@ -18,13 +22,15 @@
 #endif
 
 /******* const *******/
-#define   IADDR_SIZE  1024 /* increase for large programs */
-#define   DADDR_SIZE  1024 /* increase for large programs */
+#define   IADDR_MIN   1024 /* first iMem mapping, grown as needed */
+#define   IADDR_MAX   (1 << 24) /* no program location at or above */
+#define   DADDR_SIZE  1024 /* default dMem size, see --dmem */
 #define   NO_REGS 8
 #define   PC_REG  7
 
 #define   LINESIZE  121
 #define   WORDSIZE  20
+#define   IOBUFSIZE 65536 /* --run IN/OUT buffers */
 
 /******* type  *******/
 
@@ -67,7 +73,8 @@ typedef enum {
    srHALT,
    srIMEM_ERR,
    srDMEM_ERR,
-   srZERODIVIDE
+   srZERODIVIDE,
+   srIN_ERR    /* --run: IN found no (valid) value */
    } STEPRESULT;
 
 typedef struct {
@@ -77,14 +84,48 @@ typedef struct {
       int iarg3  ;
    } INSTRUCTION;
 
+/* operations of the pre-decoded execution engine;
+ * pc-relative jumps and constant jumps are resolved
+ * to absolute targets when the program is loaded
+ */
+typedef enum {
+   xADD, xSUB, xMUL, xDIV,
+   xLD, xST, xLDA, xLDC,
+   xJLT, xJLE, xJGT, xJGE, xJEQ, xJNE, /* reg(r) test, target in d */
+   xJMP,      /* pc = d */
+   xJREG,     /* pc = d+reg(s)    (LDA 7,d(s)) */
+   xJMEM,     /* pc = mem(d+reg(s)) (LD 7,d(s)) */
+   xSTEP      /* anything else: executed by stepTM */
+   } XOPCODE;
+
+typedef struct {
+      void * label ; /* handler address for computed goto */
+      int xop ;
+      int r, s, t, d ;
+   } XINSTRUCTION;
+
 /******** vars ********/
 int iloc = 0 ;
 int dloc = 0 ;
 int traceflag = FALSE;
 int icountflag = FALSE;
+int runflag = FALSE;   /* --run: execute to HALT without prompting */
+int slowflag = FALSE;  /* --slow: use stepTM instead of runTM */
+int statsflag = FALSE; /* --stats: report instructions per second */
+int profileflag = FALSE; /* --profile: count per instruction/address */
 
-INSTRUCTION iMem [IADDR_SIZE];
-int dMem [DADDR_SIZE];
+/* iMem, xMem and dMem are anonymous mappings: the OS
+ * hands out zero pages on first touch, and a zero
+ * INSTRUCTION is HALT 0,0,0
+ */
+INSTRUCTION * iMem = NULL ;
+int iaddrSize = 0 ; /* highest loaded location + 1 */
+int iMemCap = 0 ;   /* mapped iMem entries */
+XINSTRUCTION * xMem = NULL ; /* iaddrSize+1 for the fall-off sentinel */
+int xMemCap = 0 ;
+int xThreaded = FALSE; /* labels filled in xMem */
+int * dMem = NULL ;
+int daddrSize = DADDR_SIZE ;
 int reg [NO_REGS];
 
 char * opCodeTab[]
@@ -97,12 +138,44 @@ char * opCodeTab[]
 
 char * stepResultTab[]
         = {"OK","Halted","Instruction Memory Fault",
-           "Data Memory Fault","Division by 0"
+           "Data Memory Fault","Division by 0",
+           "Input Error"
           };
 
-char pgmName[20];
+/* --profile counters per code location, with
+ * the cgen comments of a text program: the
+ * innermost open "* -> construct" and the
+ * comment after the instruction, and the
+ * source line and function of the line table
+ */
+typedef struct {
+      long count ;       /* executions */
+      long taken ;       /* conditional jumps taken */
+      char * construct ;
+      char * comment ;
+      int line ;         /* source line from the .tml line table */
+      char * func ;      /* source function, or NULL */
+   } PROFENTRY;
+
+#define   PROF_TOP     20 /* hot spots listed */
+#define   PROF_NEST    64 /* "-> construct" nesting kept */
+
+PROFENTRY * prof = NULL ;
+int profCap = 0 ;
+int haveLines = FALSE ; /* line table read */
+long * profLoads = NULL ;  /* per dMem address */
+long * profStores = NULL ;
+
+char pgmName[120];
 FILE *pgm  ;
 
+FILE *inFile ; /* source of IN values for --run */
+char inBuf[IOBUFSIZE] ;
+int inPos = 0 ;
+int inLen = 0 ;
+char outBuf[IOBUFSIZE] ;
+int outLen = 0 ;
+
 char in_Line[LINESIZE] ;
 int lineLen ;
 int inCol  ;
@@ -111,6 +184,46 @@ char word[WORDSIZE] ;
 char ch  ;
 int done  ;
 
+/********************************************/
+/* allocMem maps n zero-filled bytes */
+void * allocMem ( size_t n )
+{ void * p = mmap(NULL, n, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0) ;
+  if (p == MAP_FAILED)
+  { printf("Out of memory (%lu bytes)\n", (unsigned long) n) ;
+    exit(1) ;
+  }
+  return p ;
+} /* allocMem */
+
+/********************************************/
+void freeMem ( void * p, size_t n )
+{ if (p != NULL) munmap(p, n) ;
+} /* freeMem */
+
+/********************************************/
+/* growIMem makes iMem[loc] addressable */
+void growIMem ( int loc )
+{ INSTRUCTION * old = iMem ;
+  int oldCap = iMemCap ;
+  if (loc < iMemCap) return ;
+  iMemCap = (oldCap < IADDR_MIN) ? IADDR_MIN : oldCap ;
+  while (iMemCap <= loc) iMemCap *= 2 ;
+  iMem = allocMem(iMemCap * sizeof(INSTRUCTION)) ;
+  if (old != NULL) memcpy(iMem, old, oldCap * sizeof(INSTRUCTION)) ;
+  freeMem(old, oldCap * sizeof(INSTRUCTION)) ;
+} /* growIMem */
+
+/********************************************/
+/* clearDMem replaces dMem by a fresh zero
+ * mapping instead of storing every word
+ */
+void clearDMem (void)
+{ freeMem(dMem, daddrSize * sizeof(int)) ;
+  dMem = allocMem(daddrSize * sizeof(int)) ;
+  dMem[0] = daddrSize - 1 ;
+} /* clearDMem */
+
 /********************************************/
 int opClass( int c )
 { if      ( c <= opRRLim) return ( opclRR );
@@ -121,7 +234,7 @@ int opClass( int c )
 /********************************************/
 void writeInstruction ( int loc )
 { printf( "%5d: ", loc) ;
-  if ( (loc >= 0) && (loc < IADDR_SIZE) )
+  if ( (loc >= 0) && (loc < iaddrSize) )
   { printf("%6s%3d,", opCodeTab[iMem[loc].iop], iMem[loc].iarg1);
     switch ( opClass(iMem[loc].iop) )
     { case opclRR: printf("%1d,%1d", iMem[loc].iarg2, iMem[loc].iarg3);
@@ -209,6 +322,57 @@ int atEOL(void)
 { return ( ! nonBlank ());
 } /* atEOL */
 
+/********************************************/
+/* inByte returns the next byte of inFile,
+ * refilling inBuf a block at a time
+ */
+int inByte (void)
+{ if (inPos == inLen)
+  { inLen = fread(inBuf, 1, IOBUFSIZE, inFile) ;
+    inPos = 0 ;
+    if (inLen <= 0)
+    { inLen = 0 ;
+      return EOF ;
+    }
+  }
+  return (unsigned char) inBuf[inPos++] ;
+} /* inByte */
+
+/********************************************/
+/* readValue parses the next signed integer of
+ * inFile into *v; FALSE at end of input or
+ * on anything that is not a number
+ */
+int readValue ( int * v )
+{ int c, sign = 1, val = 0 ;
+  do c = inByte() ; while ( (c != EOF) && isspace(c) ) ;
+  if ( (c == '+') || (c == '-') )
+  { if (c == '-') sign = -1 ;
+    c = inByte() ;
+  }
+  if ( (c == EOF) || ! isdigit(c) ) return FALSE ;
+  while ( (c != EOF) && isdigit(c) )
+  { val = val * 10 + (c - '0') ;
+    c = inByte() ;
+  }
+  *v = sign * val ;
+  return TRUE ;
+} /* readValue */
+
+/********************************************/
+void flushOut (void)
+{ fwrite(outBuf, 1, outLen, stdout) ;
+  fflush(stdout) ;
+  outLen = 0 ;
+} /* flushOut */
+
+/********************************************/
+/* writeValue appends one OUT value to outBuf */
+void writeValue ( int v )
+{ if (outLen > IOBUFSIZE - 16) flushOut() ;
+  outLen += sprintf(outBuf + outLen, "%d\n", v) ;
+} /* writeValue */
+
 /********************************************/
 int error( char * msg, int lineNo, int instNo)
 { printf("Line %d",lineNo);
@@ -217,22 +381,164 @@ int error( char * msg, int lineNo, int instNo)
   return FALSE;
 } /* error */
 
+/********************************************/
+/* decodeInstruction translates iMem[loc] into
+ * the handler form used by runTM. Anything the
+ * fast handlers cannot execute without looking
+ * at reg[PC_REG] is left to stepTM (xSTEP)
+ */
+void decodeInstruction ( int loc )
+{ INSTRUCTION * i = &iMem[loc] ;
+  XINSTRUCTION * x = &xMem[loc] ;
+  int r = i->iarg1 ;
+  x->xop = xSTEP ;
+  x->r = r ;
+  x->s = i->iarg2 ;
+  x->t = i->iarg3 ;
+  x->d = i->iarg2 ;
+  switch ( opClass(i->iop) )
+  { case opclRR :
+      if ( (i->iop < opADD) || (r == PC_REG)
+           || (x->s == PC_REG) || (x->t == PC_REG) )
+        return ;
+      x->xop = xADD + (i->iop - opADD) ;
+      return ;
+    case opclRM :
+      x->s = i->iarg3 ;
+      if (x->s == PC_REG) return ;
+      if (r == PC_REG)
+        x->xop = (i->iop == opLD) ? xJMEM : xSTEP ;
+      else
+        x->xop = (i->iop == opLD) ? xLD : xST ;
+      return ;
+    case opclRA :
+      x->s = i->iarg3 ;
+      if ( (i->iop == opLDA) || (i->iop == opLDC) )
+      { if (r != PC_REG)
+        { if (x->s == PC_REG)
+          { if (i->iop == opLDC) x->xop = xLDC ;
+            return ;
+          }
+          x->xop = (i->iop == opLDA) ? xLDA : xLDC ;
+          return ;
+        }
+        /* writes to the pc are jumps */
+        if (i->iop == opLDC) x->xop = xJMP ;
+        else if (x->s == PC_REG)
+        { x->d = i->iarg2 + loc + 1 ;
+          x->xop = xJMP ;
+        }
+        else x->xop = xJREG ;
+      }
+      else
+      { /* conditional jump: only pc-relative targets are resolved */
+        if ( (r == PC_REG) || (x->s != PC_REG) ) return ;
+        x->d = i->iarg2 + loc + 1 ;
+        x->xop = xJLT + (i->iop - opJLT) ;
+      }
+      if ( (x->xop != xJREG) && ((x->d < 0) || (x->d >= iaddrSize)) )
+        x->xop = xSTEP ;
+      return ;
+  }
+} /* decodeInstruction */
+
+/********************************************/
+void decodeInstructions (void)
+{ int loc;
+  freeMem(xMem, xMemCap * sizeof(XINSTRUCTION)) ;
+  xMemCap = iaddrSize + 1 ;
+  xMem = allocMem(xMemCap * sizeof(XINSTRUCTION)) ;
+  for (loc = 0 ; loc < iaddrSize ; loc++)
+    decodeInstruction(loc);
+  /* running off the end of iMem faults in stepTM */
+  xMem[iaddrSize].xop = xSTEP ;
+  xThreaded = FALSE ;
+} /* decodeInstructions */
+
+/********************************************/
+/* profEntry returns the profile entry of loc,
+ * growing prof as needed
+ */
+PROFENTRY * profEntry ( int loc )
+{ int cap = profCap ;
+  if (loc >= profCap)
+  { while (loc >= cap) cap = (cap == 0) ? IADDR_MIN : 2 * cap ;
+    prof = realloc(prof, cap * sizeof(PROFENTRY)) ;
+    memset(prof + profCap, 0, (cap - profCap) * sizeof(PROFENTRY)) ;
+    profCap = cap ;
+  }
+  return &prof[loc] ;
+} /* profEntry */
+
+/********************************************/
+/* profIntern returns a copy of s shared by
+ * equal strings, so constructs compare by
+ * pointer
+ */
+char * profIntern ( char * s )
+{ static char ** tab = NULL ;
+  static int n = 0 ;
+  int i ;
+  for (i = 0 ; i < n ; i++)
+    if (strcmp(tab[i], s) == 0) return tab[i] ;
+  tab = realloc(tab, (n + 1) * sizeof(char *)) ;
+  tab[n] = strdup(s) ;
+  return tab[n++] ;
+} /* profIntern */
+
+/********************************************/
+/* readLineTable reads the compiler's line
+ * table (pgm.tml) for --profile, if there is
+ * one; each "loc line function" entry holds
+ * up to the next one
+ */
+void readLineTable (void)
+{ char name[120], func[LINESIZE] ;
+  FILE * f ;
+  char * dot ;
+  int loc, line, at = 0, atLine = 0 ;
+  char * atFunc = NULL ;
+  strcpy(name, pgmName) ;
+  dot = strrchr(name, '.') ;
+  if (dot != NULL) *dot = '\0' ;
+  strcat(name, ".tml") ;
+  if ((f = fopen(name, "r")) == NULL) return ;
+  profEntry(iaddrSize) ;
+  while (fgets(in_Line, LINESIZE, f) != NULL)
+  { if ( (in_Line[0] == '*')
+         || (sscanf(in_Line, "%d %d %s", &loc, &line, func) != 3)
+         || (loc < at) )
+      continue ;
+    for ( ; (at < loc) && (at < iaddrSize) ; at++)
+    { prof[at].line = atLine ;
+      prof[at].func = atFunc ;
+    }
+    atLine = line ;
+    atFunc = (strcmp(func, "-") == 0) ? NULL : profIntern(func) ;
+  }
+  for ( ; at < iaddrSize ; at++)
+  { prof[at].line = atLine ;
+    prof[at].func = atFunc ;
+  }
+  fclose(f) ;
+  haveLines = TRUE ;
+} /* readLineTable */
+
 /********************************************/
 int readInstructions (void)
 { OPCODE op;
   int arg1, arg2, arg3;
   int loc, regNo, lineNo;
+  char * nest[PROF_NEST] ;
+  int depth = 0 ;
+  PROFENTRY * pe ;
   for (regNo = 0 ; regNo < NO_REGS ; regNo++)
       reg[regNo] = 0 ;
-  dMem[0] = DADDR_SIZE - 1 ;
-  for (loc = 1 ; loc < DADDR_SIZE ; loc++)
-      dMem[loc] = 0 ;
-  for (loc = 0 ; loc < IADDR_SIZE ; loc++)
-  { iMem[loc].iop = opHALT ;
-    iMem[loc].iarg1 = 0 ;
-    iMem[loc].iarg2 = 0 ;
-    iMem[loc].iarg3 = 0 ;
-  }
+  clearDMem() ;
+  freeMem(iMem, iMemCap * sizeof(INSTRUCTION)) ;
+  iMem = NULL ;
+  iMemCap = 0 ;
+  iaddrSize = 0 ;
   lineNo = 0 ;
   while (! feof(pgm))
   { fgets( in_Line, LINESIZE-2, pgm  ) ;
@@ -245,8 +551,8 @@ int readInstructions (void)
     { if (! getNum())
         return error("Bad location", lineNo,-1);
       loc = num;
-      if (loc > IADDR_SIZE)
-        return error("Location too large",lineNo,loc);
+      if ((loc < 0) || (loc >= IADDR_MAX))
+        return error("Bad location",lineNo,loc);
       if (! skipCh(':'))
         return error("Missing colon", lineNo,loc);
       if (! getWord ())
@@ -293,16 +599,115 @@ int readInstructions (void)
         arg3 = num;
         break;
         }
+      growIMem(loc);
+      if (loc >= iaddrSize) iaddrSize = loc + 1 ;
       iMem[loc].iop = op;
       iMem[loc].iarg1 = arg1;
       iMem[loc].iarg2 = arg2;
       iMem[loc].iarg3 = arg3;
+      if ( profileflag )
+      { pe = profEntry(loc) ;
+        pe->construct = (depth == 0) ? NULL
+                      : nest[(depth < PROF_NEST ? depth : PROF_NEST) - 1] ;
+        while ( (in_Line[inCol] == ' ') || (in_Line[inCol] == '\t')
+                || (in_Line[inCol] == ')') )
+          inCol++ ;
+        if (in_Line[inCol] != '\0') pe->comment = profIntern(in_Line + inCol) ;
+      }
+    }
+    else if ( profileflag && (in_Line[inCol] == '*') )
+    { /* cgen brackets constructs with "* -> X" and "* <- X" */
+      inCol++ ;
+      if ( nonBlank() && (strncmp(in_Line + inCol, "->", 2) == 0) )
+      { inCol += 2 ;
+        nonBlank() ;
+        if (depth < PROF_NEST) nest[depth] = profIntern(in_Line + inCol) ;
+        depth++ ;
+      }
+      else if ( (strncmp(in_Line + inCol, "<-", 2) == 0) && (depth > 0) )
+        depth-- ;
     }
   }
+  decodeInstructions();
   return TRUE;
 } /* readInstructions */
 
 
+/********************************************/
+/* isObjectFile tells whether pgm starts with
+ * the binary object magic (tmobj.h)
+ */
+int isObjectFile (void)
+{ char magic[4] ;
+  int n = fread(magic, 1, 4, pgm) ;
+  rewind(pgm) ;
+  return (n == 4) && (memcmp(magic, TMOBJ_MAGIC, 4) == 0) ;
+} /* isObjectFile */
+
+/********************************************/
+int objError( char * msg, int instNo)
+{ printf("%s",pgmName);
+  if (instNo >= 0) printf(" (Instruction %d)",instNo);
+  printf("   %s\n",msg);
+  return FALSE;
+} /* objError */
+
+/********************************************/
+/* loadObject maps a binary object file and
+ * copies its records to iMem without parsing;
+ * only opcodes and registers are checked
+ */
+int loadObject (void)
+{ struct stat st ;
+  char * base ;
+  TMOBJHEADER * h ;
+  INSTRUCTION * i ;
+  int regNo, loc, cls ;
+  for (regNo = 0 ; regNo < NO_REGS ; regNo++)
+      reg[regNo] = 0 ;
+  clearDMem() ;
+  if ( (fstat(fileno(pgm), &st) != 0)
+       || (st.st_size < (off_t) sizeof(TMOBJHEADER)) )
+    return objError("Bad object file", -1) ;
+  base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(pgm), 0) ;
+  if (base == MAP_FAILED)
+    return objError("Cannot map object file", -1) ;
+  h = (TMOBJHEADER *) base ;
+  if (h->version != TMOBJ_VERSION)
+  { munmap(base, st.st_size) ;
+    return objError("Unsupported object file version", -1) ;
+  }
+  if ( (h->recordSize != sizeof(INSTRUCTION)) || (h->count < 0)
+       || (h->count > IADDR_MAX)
+       || (st.st_size < (off_t) (sizeof(TMOBJHEADER)
+                                 + (size_t) h->count * h->recordSize)) )
+  { munmap(base, st.st_size) ;
+    return objError("Truncated object file", -1) ;
+  }
+  freeMem(iMem, iMemCap * sizeof(INSTRUCTION)) ;
+  iMem = NULL ;
+  iMemCap = 0 ;
+  iaddrSize = h->count ;
+  growIMem(iaddrSize - 1) ;
+  memcpy(iMem, base + sizeof(TMOBJHEADER),
+         (size_t) iaddrSize * sizeof(INSTRUCTION)) ;
+  munmap(base, st.st_size) ;
+  for (loc = 0 ; loc < iaddrSize ; loc++)
+  { i = &iMem[loc] ;
+    if ( (i->iop < 0) || (i->iop >= opRALim)
+         || (i->iop == opRRLim) || (i->iop == opRMLim) )
+      return objError("Illegal opcode", loc) ;
+    cls = opClass(i->iop) ;
+    if ( (i->iarg1 < 0) || (i->iarg1 >= NO_REGS)
+         || (i->iarg3 < 0) || (i->iarg3 >= NO_REGS)
+         || ( (cls == opclRR)
+              && ((i->iarg2 < 0) || (i->iarg2 >= NO_REGS)) ) )
+      return objError("Bad register", loc) ;
+  }
+  decodeInstructions() ;
+  return TRUE ;
+} /* loadObject */
+
 /********************************************/
 STEPRESULT stepTM (void)
 { INSTRUCTION currentinstruction  ;
@@ -311,7 +716,7 @@ STEPRESULT stepTM (void)
   int ok ;
 
   pc = reg[PC_REG] ;
-  if ( (pc < 0) || (pc > IADDR_SIZE)  )
+  if ( (pc < 0) || (pc >= iaddrSize)  )
       return srIMEM_ERR ;
   reg[PC_REG] = pc + 1 ;
   currentinstruction = iMem[ pc ] ;
@@ -328,7 +733,7 @@ STEPRESULT stepTM (void)
       r = currentinstruction.iarg1 ;
       s = currentinstruction.iarg3 ;
       m = currentinstruction.iarg2 + reg[s] ;
-      if ( (m < 0) || (m > DADDR_SIZE))
+      if ( (m < 0) || (m >= daddrSize))
          return srDMEM_ERR ;
       break;
 
@@ -344,12 +749,16 @@ STEPRESULT stepTM (void)
   { /* RR instructions */
     case opHALT :
     /***********************************/
-      printf("HALT: %1d,%1d,%1d\n",r,s,t);
+      if (! runflag) printf("HALT: %1d,%1d,%1d\n",r,s,t);
       return srHALT ;
       /* break; */
 
     case opIN :
     /***********************************/
+      if ( runflag )
+      { if (! readValue(&reg[r])) return srIN_ERR ;
+        break;
+      }
       do
       { printf("Enter value for IN instruction: ") ;
         fflush (stdin);
@@ -365,7 +774,8 @@ STEPRESULT stepTM (void)
       break;
 
     case opOUT :  
-      printf ("OUT instruction prints: %d\n", reg[r] ) ;
+      if ( runflag ) writeValue(reg[r]) ;
+      else printf ("OUT instruction prints: %d\n", reg[r] ) ;
       break;
     case opADD :  reg[r] = reg[s] + reg[t] ;  break;
     case opSUB :  reg[r] = reg[s] - reg[t] ;  break;
@@ -396,13 +806,333 @@ STEPRESULT stepTM (void)
   return srOKAY ;
 } /* stepTM */
 
+/********************************************/
+/* runTM executes the pre-decoded program from
+ * reg[PC_REG] until a step result other than
+ * srOKAY, dispatching through computed goto
+ * when the compiler supports it. The number
+ * of executed instructions is added to *count
+ */
+#ifndef USE_COMPUTED_GOTO
+#ifdef __GNUC__
+#define USE_COMPUTED_GOTO TRUE
+#else
+#define USE_COMPUTED_GOTO FALSE
+#endif
+#endif
+
+#if USE_COMPUTED_GOTO
+#define CASE(x)  L_##x:
+#define NEXT     { x = &xMem[pc++]; n++; goto *x->label; }
+#else
+#define CASE(x)  case x:
+#define NEXT     continue
+#endif
+
+#define JUMP(c)  { if (c) pc = x->d ; NEXT; }
+#define CHECKPC  { if ( (pc < 0) || (pc >= iaddrSize) ) \
+                   { result = srIMEM_ERR ; goto done ; } }
+#define CHECKM(m) { if ( ((m) < 0) || ((m) >= daddrSize) ) \
+                    { result = srDMEM_ERR ; goto done ; } }
+
+STEPRESULT runTM ( long * count )
+{ XINSTRUCTION * x ;
+  STEPRESULT result ;
+  long n = 0 ;
+  int pc, m ;
+#if USE_COMPUTED_GOTO
+  static void * labels[]
+        = { &&L_xADD, &&L_xSUB, &&L_xMUL, &&L_xDIV,
+            &&L_xLD, &&L_xST, &&L_xLDA, &&L_xLDC,
+            &&L_xJLT, &&L_xJLE, &&L_xJGT, &&L_xJGE, &&L_xJEQ, &&L_xJNE,
+            &&L_xJMP, &&L_xJREG, &&L_xJMEM, &&L_xSTEP } ;
+  if (! xThreaded)
+  { for (pc = 0 ; pc <= iaddrSize ; pc++)
+      xMem[pc].label = labels[xMem[pc].xop] ;
+    xThreaded = TRUE ;
+  }
+#endif
+  pc = reg[PC_REG] ;
+  CHECKPC;
+#if USE_COMPUTED_GOTO
+  NEXT;
+#else
+  for (;;)
+  { x = &xMem[pc++] ;
+    n++ ;
+    switch (x->xop) {
+#endif
+  CASE(xADD)  reg[x->r] = reg[x->s] + reg[x->t] ; NEXT;
+  CASE(xSUB)  reg[x->r] = reg[x->s] - reg[x->t] ; NEXT;
+  CASE(xMUL)  reg[x->r] = reg[x->s] * reg[x->t] ; NEXT;
+  CASE(xDIV)
+    if (reg[x->t] == 0)
+    { result = srZERODIVIDE ; goto done ; }
+    reg[x->r] = reg[x->s] / reg[x->t] ;
+    NEXT;
+  CASE(xLD)   m = x->d + reg[x->s] ; CHECKM(m) ; reg[x->r] = dMem[m] ; NEXT;
+  CASE(xST)   m = x->d + reg[x->s] ; CHECKM(m) ; dMem[m] = reg[x->r] ; NEXT;
+  CASE(xLDA)  reg[x->r] = x->d + reg[x->s] ; NEXT;
+  CASE(xLDC)  reg[x->r] = x->d ; NEXT;
+  CASE(xJLT)  JUMP(reg[x->r] <  0) ;
+  CASE(xJLE)  JUMP(reg[x->r] <= 0) ;
+  CASE(xJGT)  JUMP(reg[x->r] >  0) ;
+  CASE(xJGE)  JUMP(reg[x->r] >= 0) ;
+  CASE(xJEQ)  JUMP(reg[x->r] == 0) ;
+  CASE(xJNE)  JUMP(reg[x->r] != 0) ;
+  CASE(xJMP)  pc = x->d ; NEXT;
+  CASE(xJREG) pc = x->d + reg[x->s] ; CHECKPC ; NEXT;
+  CASE(xJMEM)
+    m = x->d + reg[x->s] ; CHECKM(m) ;
+    pc = dMem[m] ; CHECKPC ;
+    NEXT;
+  CASE(xSTEP)
+    reg[PC_REG] = pc - 1 ;
+    result = stepTM () ;
+    pc = reg[PC_REG] ;
+    if (result != srOKAY) goto done ;
+    CHECKPC;
+    NEXT;
+#if !USE_COMPUTED_GOTO
+    }
+  }
+#endif
+done:
+  reg[PC_REG] = pc ;
+  *count += n ;
+  return result ;
+} /* runTM */
+
+/********************************************/
+/* printStats reports the instruction count and
+ * the execution speed since start (on stderr
+ * under --run, which keeps stdout for OUT values)
+ */
+void printStats ( long count, clock_t start )
+{ double secs = (double) (clock() - start) / CLOCKS_PER_SEC ;
+  FILE * f = runflag ? stderr : stdout ;
+  fprintf(f,"Number of instructions executed = %ld\n",count);
+  if ( statsflag )
+  { fprintf(f,"Execution time = %.3f s\n",secs);
+    if (secs > 0)
+      fprintf(f,"Instructions per second = %.0f\n",count / secs);
+  }
+} /* printStats */
+
+/********************************************/
+/* profStep counts the instruction at loc
+ * before stepTM executes it: the execution,
+ * a taken conditional jump, or the data
+ * address of a load or store
+ */
+void profStep ( int loc )
+{ INSTRUCTION * i ;
+  PROFENTRY * pe ;
+  int m, v, taken ;
+  if ( (loc < 0) || (loc >= iaddrSize) ) return ;
+  i = &iMem[loc] ;
+  pe = profEntry(loc) ;
+  pe->count++ ;
+  if ( (i->iop == opLD) || (i->iop == opST) )
+  { m = i->iarg2 + reg[i->iarg3] ;
+    if ( (m >= 0) && (m < daddrSize) )
+    { if (i->iop == opLD) profLoads[m]++ ;
+      else profStores[m]++ ;
+    }
+  }
+  else if (i->iop >= opJLT)
+  { v = reg[i->iarg1] ;
+    switch (i->iop)
+    { case opJLT : taken = v <  0 ; break;
+      case opJLE : taken = v <= 0 ; break;
+      case opJGT : taken = v >  0 ; break;
+      case opJGE : taken = v >= 0 ; break;
+      case opJEQ : taken = v == 0 ; break;
+      default :    taken = v != 0 ; break;
+    }
+    if (taken) pe->taken++ ;
+  }
+} /* profStep */
+
+/********************************************/
+/* profClear zeroes the profile counters */
+void profClear (void)
+{ int loc ;
+  for (loc = 0 ; loc < profCap ; loc++)
+    prof[loc].count = prof[loc].taken = 0 ;
+  free(profLoads) ;
+  free(profStores) ;
+  profLoads = calloc(daddrSize, sizeof(long)) ;
+  profStores = calloc(daddrSize, sizeof(long)) ;
+} /* profClear */
+
+/* sort keys for printProfile */
+long * profKey ;
+
+int profByKey ( const void * a, const void * b )
+{ long x = profKey[*(int *) a], y = profKey[*(int *) b] ;
+  return (x < y) - (x > y) ;
+}
+
+/********************************************/
+/* profTop sorts the indices 0..n-1 by key,
+ * largest first, into order
+ */
+void profTop ( int * order, long * key, int n )
+{ int j ;
+  for (j = 0 ; j < n ; j++) order[j] = j ;
+  profKey = key ;
+  qsort(order, n, sizeof(int), profByKey) ;
+} /* profTop */
+
+/********************************************/
+/* printByName reports the executions summed
+ * over the locations with the same (interned)
+ * name[loc], in order of appearance
+ */
+void printByName ( FILE * f, char * title, char ** name, double pct )
+{ char ** names = malloc((iaddrSize + 1) * sizeof(char *)) ;
+  long * sums = calloc(iaddrSize + 1, sizeof(long)) ;
+  int loc, j, n = 0 ;
+  for (loc = 0 ; loc < iaddrSize ; loc++)
+  { for (j = 0 ; (j < n) && (names[j] != name[loc]) ; j++)
+      ;
+    if (j == n) names[n++] = name[loc] ;
+    sums[j] += prof[loc].count ;
+  }
+  if ( (n > 1) || ((n == 1) && (names[0] != NULL)) )
+  { fprintf(f,"\n%s:\n", title) ;
+    for (j = 0 ; j < n ; j++)
+      if (sums[j] > 0)
+        fprintf(f,"%11ld %6.2f  %s\n", sums[j], sums[j] * pct,
+                (names[j] != NULL) ? names[j] : "(outside)") ;
+  }
+  free(names) ;
+  free(sums) ;
+} /* printByName */
+
+/********************************************/
+/* printProfile reports the hot instructions,
+ * the time per cgen construct, source line
+ * and function, and the most used data
+ * addresses
+ */
+void printProfile ( long total )
+{ FILE * f = runflag ? stderr : stdout ;
+  int * order ;
+  char ** name ;
+  long * key ;
+  char ** lineFunc ;
+  int loc, j, n, maxLine = 0 ;
+  PROFENTRY * pe ;
+  INSTRUCTION * i ;
+  double pct = (total > 0) ? 100.0 / total : 0.0 ;
+  profEntry(iaddrSize) ;
+  for (loc = 0 ; loc < iaddrSize ; loc++)
+    if (prof[loc].line > maxLine) maxLine = prof[loc].line ;
+  n = (iaddrSize > daddrSize) ? iaddrSize : daddrSize ;
+  if (maxLine >= n) n = maxLine + 1 ;
+  order = malloc(n * sizeof(int)) ;
+  key = calloc(n, sizeof(long)) ;
+  name = malloc((iaddrSize + 1) * sizeof(char *)) ;
+
+  fprintf(f,"\nHot instructions:\n") ;
+  fprintf(f,"  loc       count      %%       taken  instruction\n") ;
+  for (loc = 0 ; loc < iaddrSize ; loc++) key[loc] = prof[loc].count ;
+  profTop(order, key, iaddrSize) ;
+  for (j = 0 ; (j < iaddrSize) && (j < PROF_TOP) ; j++)
+  { pe = &prof[order[j]] ;
+    i = &iMem[order[j]] ;
+    if (pe->count == 0) break ;
+    fprintf(f,"%5d %11ld %6.2f ", order[j], pe->count, pe->count * pct) ;
+    if (i->iop >= opJLT) fprintf(f,"%11ld  ", pe->taken) ;
+    else fprintf(f,"%11s  ", "") ;
+    if (opClass(i->iop) == opclRR)
+      fprintf(f,"%-4s %d,%d,%d", opCodeTab[i->iop],
+              i->iarg1, i->iarg2, i->iarg3) ;
+    else
+      fprintf(f,"%-4s %d,%d(%d)", opCodeTab[i->iop],
+              i->iarg1, i->iarg2, i->iarg3) ;
+    if (haveLines) fprintf(f,"  line %d", pe->line) ;
+    if (pe->construct != NULL) fprintf(f,"  [%s]", pe->construct) ;
+    if (pe->comment != NULL) fprintf(f,"  %s", pe->comment) ;
+    fprintf(f,"\n") ;
+  }
+
+  for (loc = 0 ; loc < iaddrSize ; loc++) name[loc] = prof[loc].construct ;
+  printByName(f, "Time per construct", name, pct) ;
+
+  if (haveLines)
+  { for (loc = 0 ; loc < iaddrSize ; loc++) name[loc] = prof[loc].func ;
+    printByName(f, "Time per function", name, pct) ;
+    /* the function of a line is that of its last location */
+    lineFunc = calloc(maxLine + 1, sizeof(char *)) ;
+    memset(key, 0, n * sizeof(long)) ;
+    for (loc = 0 ; loc < iaddrSize ; loc++)
+    { key[prof[loc].line] += prof[loc].count ;
+      lineFunc[prof[loc].line] = prof[loc].func ;
+    }
+    fprintf(f,"\nTime per source line:\n") ;
+    fprintf(f," line       count      %%  function\n") ;
+    profTop(order, key, maxLine + 1) ;
+    for (j = 0 ; (j <= maxLine) && (j < PROF_TOP) ; j++)
+    { if (key[order[j]] == 0) break ;
+      fprintf(f,"%5d %11ld %6.2f  %s\n", order[j], key[order[j]],
+              key[order[j]] * pct,
+              (lineFunc[order[j]] != NULL) ? lineFunc[order[j]] : "") ;
+    }
+    free(lineFunc) ;
+  }
+
+  fprintf(f,"\nData addresses:\n") ;
+  fprintf(f," addr       loads      stores\n") ;
+  for (loc = 0 ; loc < daddrSize ; loc++)
+    key[loc] = profLoads[loc] + profStores[loc] ;
+  profTop(order, key, daddrSize) ;
+  for (j = 0 ; (j < daddrSize) && (j < PROF_TOP) ; j++)
+  { loc = order[j] ;
+    if (key[loc] == 0) break ;
+    fprintf(f,"%5d %11ld %11ld\n", loc, profLoads[loc], profStores[loc]) ;
+  }
+  free(order) ;
+  free(key) ;
+  free(name) ;
+} /* printProfile */
+
+/********************************************/
+/* goTM executes until HALT or an error, one
+ * stepTM at a time when tracing (or --slow,
+ * --profile),
+ * otherwise through the pre-decoded engine
+ */
+STEPRESULT goTM ( int trace )
+{ STEPRESULT stepResult = srOKAY ;
+  long stepcnt = 0 ;
+  clock_t start = clock() ;
+  if ( trace || slowflag || profileflag )
+  { while (stepResult == srOKAY)
+    { iloc = reg[PC_REG] ;
+      if ( trace ) writeInstruction( iloc ) ;
+      if ( profileflag ) profStep( iloc ) ;
+      stepResult = stepTM ();
+      stepcnt++;
+    }
+  }
+  else stepResult = runTM ( &stepcnt ) ;
+  if ( icountflag || statsflag )
+    printStats ( stepcnt, start ) ;
+  if ( profileflag )
+    printProfile ( stepcnt ) ;
+  return stepResult ;
+} /* goTM */
+
 /********************************************/
 int doCommand (void)
 { char cmd;
   int stepcnt=0, i;
   int printcnt;
   int stepResult;
-  int regNo, loc;
+  int regNo;
   do
   { printf ("Enter command: ");
     fflush (stdin);
@@ -482,7 +1212,7 @@ int doCommand (void)
       if ( ! atEOL ())
         printf ("Instruction locations?\n");
       else
-      { while ((iloc >= 0) && (iloc < IADDR_SIZE)
+      { while ((iloc >= 0) && (iloc < iaddrSize)
                 && (printcnt > 0) )
         { writeInstruction(iloc);
           iloc++ ;
@@ -501,7 +1231,7 @@ int doCommand (void)
       if ( ! atEOL ())
         printf("Data locations?\n");
       else
-      { while ((dloc >= 0) && (dloc < DADDR_SIZE)
+      { while ((dloc >= 0) && (dloc < daddrSize)
                   && (printcnt > 0))
         { printf("%5d: %5d\n",dloc,dMem[dloc]);
           dloc++;
@@ -517,9 +1247,8 @@ int doCommand (void)
       stepcnt = 0;
       for (regNo = 0;  regNo < NO_REGS ; regNo++)
             reg[regNo] = 0 ;
-      dMem[0] = DADDR_SIZE - 1 ;
-      for (loc = 1 ; loc < DADDR_SIZE ; loc++)
-            dMem[loc] = 0 ;
+      clearDMem() ;
+      if ( profileflag ) profClear() ;
       break;
 
     case 'q' : return FALSE;  /* break; */
@@ -529,15 +1258,7 @@ int doCommand (void)
   stepResult = srOKAY;
   if ( stepcnt > 0 )
   { if ( cmd == 'g' )
-    { stepcnt = 0;
-      while (stepResult == srOKAY)
-      { iloc = reg[PC_REG] ;
-        if ( traceflag ) writeInstruction( iloc ) ;
-        stepResult = stepTM ();
-        stepcnt++;
-      }
-      if ( icountflag )
-        printf("Number of instructions executed = %d\n",stepcnt);
+    { stepResult = goTM ( traceflag ) ;
     }
     else
     { while ((stepcnt > 0) && (stepResult == srOKAY))
@@ -558,22 +1279,78 @@ int doCommand (void)
 /********************************************/
 
 main( int argc, char * argv[] )
-{ if (argc != 2)
-  { printf("usage: %s <filename>\n",argv[0]);
+{ STEPRESULT stepResult ;
+  char * fileName = NULL ;
+  char * inName = NULL ;
+  int i ;
+  for (i = 1 ; i < argc ; i++)
+  { if (strcmp(argv[i],"--run") == 0) runflag = TRUE ;
+    else if ( (strcmp(argv[i],"--in") == 0) && (i+1 < argc) )
+    { inName = argv[++i] ;
+      runflag = TRUE ;
+    }
+    else if ( (strcmp(argv[i],"--dmem") == 0) && (i+1 < argc)
+              && (atoi(argv[i+1]) > 0) )
+      daddrSize = atoi(argv[++i]) ;
+    else if (strcmp(argv[i],"--slow") == 0) slowflag = TRUE ;
+    else if (strcmp(argv[i],"--stats") == 0) statsflag = TRUE ;
+    else if (strcmp(argv[i],"--profile") == 0) profileflag = TRUE ;
+    else if ( (argv[i][0] == '-') || (fileName != NULL) )
+    { fileName = NULL ;
+      break ;
+    }
+    else fileName = argv[i] ;
+  }
+  if (fileName == NULL)
+  { printf("usage: %s [--run] [--in <file>] [--dmem <n>] [--slow] [--stats]"
+           " [--profile] <filename>\n", argv[0]);
+    printf("   --run         execute to HALT without the command prompt;\n"
+           "                 IN reads stdin, OUT writes one value per line,\n"
+           "                 exit code 0 on HALT, else the step result\n");
+    printf("   --in <file>   read IN values from file (implies --run)\n");
+    printf("   --dmem <n>    data memory size in words (default %d)\n",
+           DADDR_SIZE);
+    printf("   --slow        execute one stepTM at a time\n");
+    printf("   --stats       report instructions per second\n");
+    printf("   --profile     report hot instructions, taken jumps and\n"
+           "                 loads/stores per data address after a run;\n"
+           "                 a text program adds its cgen comments,\n"
+           "                 and the compiler's .tml line table adds\n"
+           "                 source lines and functions\n");
     exit(1);
   }
-  strcpy(pgmName,argv[1]) ;
+  strcpy(pgmName,fileName) ;
   if (strchr (pgmName, '.') == NULL)
      strcat(pgmName,".tm");
-  pgm = fopen(pgmName,"r");
+  pgm = fopen(pgmName,"rb");
   if (pgm == NULL)
   { printf("file '%s' not found\n",pgmName);
     exit(1);
   }
 
   /* read the program */
-  if ( ! readInstructions ())
+  if ( isObjectFile () )
+  { if ( ! loadObject ())
+         exit(1) ;
+  }
+  else if ( ! readInstructions ())
          exit(1) ;
+  if ( profileflag )
+  { profClear() ;
+    readLineTable() ;
+  }
+  if ( runflag )
+  { inFile = stdin ;
+    if ( (inName != NULL) && ((inFile = fopen(inName,"r")) == NULL) )
+    { fprintf(stderr,"file '%s' not found\n",inName);
+      exit(1);
+    }
+    stepResult = goTM ( FALSE ) ;
+    flushOut () ;
+    if (stepResult == srHALT) return 0;
+    fprintf(stderr, "%s\n",stepResultTab[stepResult] );
+    return stepResult;
+  }
   /* switch input file to terminal */
   /* reset( input ); */
   /* read-eval-print */
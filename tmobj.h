@@ -0,0 +1,47 @@
+/****************************************************/
+/* File: tmobj.h                                    */
+/* Binary TM object format shared by the code       */
+/* emitter (code.c) and the TM simulator (tm.c)     */
+/****************************************************/
+
+#ifndef _TMOBJ_H_
+#define _TMOBJ_H_
+
+#include <stdint.h>
+
+/* An object file is a TMOBJHEADER followed by
+ * count TMOBJRECORDs; record i holds the
+ * instruction at location i. Fields are 32 bit
+ * in host byte order, so a .tmo file is only
+ * meant for the machine that produced it
+ */
+#define TMOBJ_MAGIC   "TMOB"
+#define TMOBJ_VERSION 1
+
+typedef struct
+   { char magic[4];
+     int32_t version;
+     int32_t count;      /* number of instruction records */
+     int32_t recordSize; /* sizeof(TMOBJRECORD) */
+   } TMOBJHEADER;
+
+/* op is the opcode number (index in TMOBJ_OPCODES);
+ * RO: r,s,t are registers, RM/RA: r, d, s
+ * (the same layout as INSTRUCTION in tm.c)
+ */
+typedef struct
+   { int32_t op;
+     int32_t arg1;
+     int32_t arg2;
+     int32_t arg3;
+   } TMOBJRECORD;
+
+/* opcode numbers, in the order of OPCODE in tm.c */
+#define TMOBJ_OPCODES \
+   { "HALT","IN","OUT","ADD","SUB","MUL","DIV","????", \
+     "LD","ST","????", \
+     "LDA","LDC","JLT","JLE","JGT","JGE","JEQ","JNE" }
+
+#define TMOBJ_NUM_OPCODES 19
+
+#endif
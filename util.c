@@ -61,38 +61,107 @@ void printToken( TokenType token, const char* tokenString )
   }
 }
 
-/* Function newStmtNode creates a new statement
- * node for syntax tree construction
+/* The arena holds the syntax tree and the
+ * identifier strings of a compilation unit in
+ * large chunks, handed out by bumping a pointer
+ * and released together by arenaRelease
  */
-TreeNode * newStmtNode(StmtKind kind)
-{ TreeNode * t = (TreeNode *) malloc(sizeof(TreeNode));
-  int i;
+#define ARENA_CHUNK 65536
+#define ARENA_ALIGN sizeof(double)
+
+typedef struct arenaChunk
+   { struct arenaChunk * next;
+     size_t size;
+     double data[1]; /* aligned start of the chunk's space */
+   } ArenaChunk;
+
+static ArenaChunk * arena = NULL;
+static char * arenaNext = NULL;
+static char * arenaEnd = NULL;
+
+/* statistics for arenaStats */
+static long arenaObjects = 0;
+static long arenaChunks = 0;
+static long arenaBytes = 0;
+
+/* Function arenaAlloc returns n bytes from the
+ * arena, or NULL if out of memory
+ */
+void * arenaAlloc( size_t n )
+{ ArenaChunk * c;
+  size_t size;
+  char * p;
+  n = (n + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+  if (arenaNext == NULL || (size_t) (arenaEnd - arenaNext) < n)
+  { size = (n > ARENA_CHUNK) ? n : ARENA_CHUNK;
+    c = malloc(sizeof(ArenaChunk) + size);
+    if (c == NULL) return NULL;
+    c->next = arena;
+    c->size = size;
+    arena = c;
+    arenaNext = (char *) c->data;
+    arenaEnd = arenaNext + size;
+    arenaChunks++;
+  }
+  p = arenaNext;
+  arenaNext += n;
+  arenaObjects++;
+  arenaBytes += n;
+  return p;
+}
+
+/* Procedure arenaRelease frees everything
+ * allocated from the arena
+ */
+void arenaRelease(void)
+{ ArenaChunk * c;
+  while (arena != NULL)
+  { c = arena->next;
+    free(arena);
+    arena = c;
+  }
+  arenaNext = arenaEnd = NULL;
+}
+
+/* Procedure arenaStats prints the arena's
+ * allocation counts to the listing file
+ */
+void arenaStats(void)
+{ fprintf(listing,"Arena: %ld objects, %ld bytes in %ld chunks\n",
+          arenaObjects,arenaBytes,arenaChunks);
+}
+
+/* Function newNode creates a new node of
+ * kind k in the arena with no children
+ */
+static TreeNode * newNode(NodeKind k)
+{ TreeNode * t = (TreeNode *) arenaAlloc(sizeof(TreeNode));
   if (t==NULL)
     fprintf(listing,"Out of memory error at line %d\n",lineno);
   else {
-    for (i=0;i<MAXCHILDREN;i++) t->child[i] = NULL;
-    t->sibling = NULL;
-    t->nodekind = StmtK;
-    t->kind.stmt = kind;
+    memset(t,0,sizeof(TreeNode));
+    t->nodekind = k;
     t->lineno = lineno;
   }
   return t;
 }
 
+/* Function newStmtNode creates a new statement
+ * node for syntax tree construction
+ */
+TreeNode * newStmtNode(StmtKind kind)
+{ TreeNode * t = newNode(StmtK);
+  if (t!=NULL) t->kind.stmt = kind;
+  return t;
+}
+
 /* Function newExpNode creates a new expression 
  * node for syntax tree construction
  */
 TreeNode * newExpNode(ExpKind kind)
-{ TreeNode * t = (TreeNode *) malloc(sizeof(TreeNode));
-  int i;
-  if (t==NULL)
-    fprintf(listing,"Out of memory error at line %d\n",lineno);
-  else {
-    for (i=0;i<MAXCHILDREN;i++) t->child[i] = NULL;
-    t->sibling = NULL;
-    t->nodekind = ExpK;
+{ TreeNode * t = newNode(ExpK);
+  if (t!=NULL) {
     t->kind.exp = kind;
-    t->lineno = lineno;
     t->type = Void;
   }
   return t;
@@ -102,17 +171,8 @@ TreeNode * newExpNode(ExpKind kind)
  * node for syntax tree construction
  */
 TreeNode * newDeclNode(DeclKind kind)
-{ TreeNode * t = (TreeNode *) malloc(sizeof(TreeNode));
-  int i;
-  if (t==NULL)
-    fprintf(listing,"Out of memory error at line %d\n",lineno);
-  else {
-    for (i=0;i<MAXCHILDREN;i++) t->child[i] = NULL;
-    t->sibling = NULL;
-    t->nodekind = DeclK;
-    t->kind.decl = kind;
-    t->lineno = lineno;
-  }
+{ TreeNode * t = newNode(DeclK);
+  if (t!=NULL) t->kind.decl = kind;
   return t;
 }
 
@@ -120,17 +180,8 @@ TreeNode * newDeclNode(DeclKind kind)
  * node for syntax tree construction
  */
 TreeNode * newParamNode(ParamKind kind)
-{ TreeNode * t = (TreeNode *) malloc(sizeof(TreeNode));
-  int i;
-  if (t==NULL)
-    fprintf(listing,"Out of memory error at line %d\n",lineno);
-  else {
-    for (i=0;i<MAXCHILDREN;i++) t->child[i] = NULL;
-    t->sibling = NULL;
-    t->nodekind = ParamK;
-    t->kind.param = kind;
-    t->lineno = lineno;
-  }
+{ TreeNode * t = newNode(ParamK);
+  if (t!=NULL) t->kind.param = kind;
   return t;
 }
 
@@ -138,32 +189,103 @@ TreeNode * newParamNode(ParamKind kind)
  * node for syntax tree construction
  */
 TreeNode * newTypeNode(TypeKind kind)
-{ TreeNode * t = (TreeNode *) malloc(sizeof(TreeNode));
-  int i;
-  if (t==NULL)
-    fprintf(listing,"Out of memory error at line %d\n",lineno);
-  else {
-    for (i=0;i<MAXCHILDREN;i++) t->child[i] = NULL;
-    t->sibling = NULL;
-    t->nodekind = TypeK;
-    t->kind.type = kind;
-    t->lineno = lineno;
-  }
+{ TreeNode * t = newNode(TypeK);
+  if (t!=NULL) t->kind.type = kind;
   return t;
 }
 
-/* Function copyString allocates and makes a new
- * copy of an existing string
+/* a walkTree stack frame: node and the
+ * index of the next child to visit, -1
+ * before preProc has been called
+ */
+typedef struct
+   { TreeNode * node;
+     int child;
+   } WalkFrame;
+
+/* Procedure walkTree applies preProc in preorder
+ * and postProc in postorder to every node of the
+ * tree t and its siblings, in the order of a
+ * recursive walk
+ */
+void walkTree( TreeNode * t, TreeProc preProc, TreeProc postProc )
+{ walkChildren(t,preProc,NULL,postProc);
+}
+
+/* Procedure walkChildren is walkTree with a
+ * childProc hook before each child index. A
+ * node's frame is replaced by its sibling, so
+ * the stack only grows with the nesting depth
+ */
+void walkChildren( TreeNode * t, TreeProc preProc, ChildProc childProc,
+                   TreeProc postProc )
+{ WalkFrame * stack;
+  WalkFrame * f;
+  int top = 0, size = 64, i;
+  TreeNode * c;
+  if (t == NULL) return;
+  stack = (WalkFrame *) malloc(size*sizeof(WalkFrame));
+  stack[top].node = t;
+  stack[top++].child = -1;
+  while (top > 0)
+  { f = &stack[top-1];
+    if (f->child < 0)
+    { if (preProc != NULL) preProc(f->node);
+      f->child = 0;
+    }
+    if (f->child < MAXCHILDREN)
+    { i = f->child++;
+      c = f->node->child[i];
+      if ((childProc != NULL) && ! childProc(f->node,i)) c = NULL;
+      if (c != NULL)
+      { if (top == size)
+        { size *= 2;
+          stack = (WalkFrame *) realloc(stack, size*sizeof(WalkFrame));
+        }
+        stack[top].node = c;
+        stack[top++].child = -1;
+      }
+    }
+    else
+    { if (postProc != NULL) postProc(f->node);
+      if (f->node->sibling != NULL)
+      { f->node = f->node->sibling;
+        f->child = -1;
+      }
+      else top--;
+    }
+  }
+  free(stack);
+}
+
+/* Function reverseList reverses the sibling
+ * list t in place and returns its new head;
+ * the parser builds each list backwards, one
+ * step per item, and turns it around once
+ */
+TreeNode * reverseList(TreeNode * t)
+{ TreeNode * r = NULL, * next;
+  while (t != NULL)
+  { next = t->sibling;
+    t->sibling = r;
+    r = t;
+    t = next;
+  }
+  return r;
+}
+
+/* Function copyString makes a new copy of an
+ * existing string in the arena
  */
 char * copyString(char * s)
 { int n;
   char * t;
   if (s==NULL) return NULL;
   n = strlen(s)+1;
-  t = malloc(n);
+  t = arenaAlloc(n);
   if (t==NULL)
     fprintf(listing,"Out of memory error at line %d\n",lineno);
-  else strcpy(t,s);
+  else memcpy(t,s,n);
   return t;
 }
 
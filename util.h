@@ -13,6 +13,22 @@
  */
 void printToken( TokenType, const char* );
 
+/* Function arenaAlloc returns n bytes from the
+ * arena that holds the syntax tree and identifier
+ * strings, or NULL if out of memory
+ */
+void * arenaAlloc( size_t n );
+
+/* Procedure arenaRelease frees everything
+ * allocated from the arena
+ */
+void arenaRelease(void);
+
+/* Procedure arenaStats prints the arena's
+ * allocation counts to the listing file
+ */
+void arenaStats(void);
+
 /* Function newStmtNode creates a new statement
  * node for syntax tree construction
  */
@@ -38,8 +54,39 @@ TreeNode * newParamNode(ParamKind);
  */
 TreeNode * newTypeNode(TypeKind);
 
-/* Function copyString allocates and makes a new
- * copy of an existing string
+/* TreeProc is a hook called by walkTree */
+typedef void (* TreeProc) (TreeNode *);
+
+/* Procedure walkTree applies preProc in preorder
+ * and postProc in postorder to every node of the
+ * tree t and its siblings; it keeps an explicit
+ * stack, so long lists and deep nesting do not
+ * grow the C stack. Either hook may be NULL
+ */
+void walkTree( TreeNode * t, TreeProc preProc, TreeProc postProc );
+
+/* ChildProc is a hook called by walkChildren
+ * before child i of a node is visited; it
+ * returns FALSE to skip child i
+ */
+typedef int (* ChildProc) (TreeNode *, int);
+
+/* Procedure walkChildren is walkTree with a
+ * childProc hook, called for every child index
+ * of a node (even a NULL child) between its
+ * preProc and postProc, so a hook can emit code
+ * between children or leave them out
+ */
+void walkChildren( TreeNode * t, TreeProc preProc, ChildProc childProc,
+                   TreeProc postProc );
+
+/* Function reverseList reverses the sibling
+ * list t in place and returns its new head
+ */
+TreeNode * reverseList( TreeNode * );
+
+/* Function copyString makes a new copy of an
+ * existing string in the arena
  */
 char * copyString( char * );
 